@@ -11,6 +11,9 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 #include <sys/time.h>
 
@@ -66,6 +69,48 @@ void parseLandmarks(LM_storage& landmarks, const char* filename){
 	}
 }
 
+/**
+ * Repeated observations of a landmark from the same pose, fused into one
+ * observation weighted by their information. With the calibration the
+ * fusion is only exact if the covariances are equal.
+ */
+struct FusedObservation {
+	int count;
+	double z[2], cov[3];     // the first observation, cov is the upper triangle
+	double information[3];  // sum of the inverse covariances, upper triangle
+	double weighted[2];     // sum of the information times the observation
+
+	FusedObservation() : count(0) {
+		std::fill_n(information, 3, 0.0);
+		std::fill_n(weighted, 2, 0.0);
+	}
+
+	void add(const double *obs, const double *obsCov){
+		if(count++ == 0){
+			std::copy(obs, obs+2, z);
+			std::copy(obsCov, obsCov+3, cov);
+		}
+		double det = obsCov[0]*obsCov[2] - obsCov[1]*obsCov[1];
+		double inf[3] = {obsCov[2]/det, -obsCov[1]/det, obsCov[0]/det};
+		for(int k=0; k<3; k++) information[k] += inf[k];
+		weighted[0] += inf[0]*obs[0] + inf[1]*obs[1];
+		weighted[1] += inf[1]*obs[0] + inf[2]*obs[1];
+	}
+
+	/**
+	 * Replaces z and cov by the fused observation.
+	 */
+	void fuse(){
+		if(count < 2) return;
+		double det = information[0]*information[2] - information[1]*information[1];
+		cov[0] = information[2]/det;
+		cov[1] = -information[1]/det;
+		cov[2] = information[0]/det;
+		z[0] = cov[0]*weighted[0] + cov[1]*weighted[1];
+		z[1] = cov[1]*weighted[0] + cov[2]*weighted[1];
+	}
+};
+
 void parse(Poses &poses, LM_storage &landmarks,
 		deque<Odo> &odometry, deque<LM_obs> &lm_obs,
 		Estimator &e, DLR_Data_Parser &p,
@@ -89,6 +134,9 @@ void parse(Poses &poses, LM_storage &landmarks,
 		e.insertMeasurement( &odometry.back() );
 		out << "added STEP" << endl;
 		vector<double> lmob;
+		// one measurement per landmark seen from this pose:
+		map<int, FusedObservation> fused;
+		vector<int> seen;
 		while ( p.get_next_landmark(lmob) ) {
 			Vect<2> t_vec2( &lmob[0] );
 			// insert landmark for every ID
@@ -102,17 +150,23 @@ void parse(Poses &poses, LM_storage &landmarks,
 						landmarks[id] = next_pos.local2World( t_vec2 );
 						e.insertRV( &landmarks[id]);
 					}
-					lm_obs.push_back(LM_obs(poses.back(), landmarks[id],
-#ifdef DLR_CALIBRATE
-							cal,
-#endif
-							t_vec2, CholeskyCovariance<2>( &lmob[3], CholeskyMode::CHOLESKY_UPPER ) )
-					);
-					e.insertMeasurement( &lm_obs.back() );
+					if (fused.find(id) == fused.end() ) seen.push_back(id);
+					fused[id].add(&lmob[0], &lmob[3]);
 				}
 			}
 			out << "Added Landmark" << endl;
 		}
+		for(size_t k=0; k<seen.size(); k++){
+			FusedObservation &obs = fused[seen[k]];
+			obs.fuse();
+			lm_obs.push_back(LM_obs(poses.back(), landmarks[seen[k]],
+#ifdef DLR_CALIBRATE
+					cal,
+#endif
+					Vect<2>(obs.z), CholeskyCovariance<2>( obs.cov, CholeskyMode::CHOLESKY_UPPER ) )
+			);
+			e.insertMeasurement( &lm_obs.back() );
+		}
 	}
 }
 
@@ -173,6 +227,12 @@ int main(int argc, char* argv[])
 	struct timeval ts, te;
 	gettimeofday(&ts,0);
 	e.initialize();
+	if(e.getUnconstrained() > 0){
+		// Gauss-Newton can not make a step:
+		cout << e.getUnconstrained() << " variables without measurement" << endl;
+		return 1;
+	}
+	e.setLogger(&std::cout);
 	std::cout << "Initialization done" << std::endl;
 	int steps_arg = 20;
 	for(int k=1; k <= steps_arg; k++){
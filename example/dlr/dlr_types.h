@@ -8,7 +8,7 @@
 
 #include <types/Measurement.h>
 #include <tools/MakePose.h>
-#include <tools/CholeskyCovariance.h>
+#include <tools/NoiseModel.h>
 
 #include "../tools.h"
 
@@ -23,7 +23,7 @@ MAKE_POSE2D(Pose, pos , orientation, )
 /// Measurements:
 
 BUILD_MEASUREMENT(Odo, 3, ((Pose, t0)) ((Pose, t1)),
-                  ((Pose_T, odo)) ((SLOM::CholeskyCovariance<3>, cov)) )
+                  ((Pose_T, odo)) ((SLOM::SharedCovariance<3>, cov)) )
 double* Odo::eval(double ret[3]) const
 {
 	Pose_T diff = t0->world2Local(*t1);
@@ -34,7 +34,7 @@ double* Odo::eval(double ret[3]) const
 
 
 BUILD_MEASUREMENT(LM_observation, 2, ((Pose, pose)) ((LandMark, lm)),
-		((SLOM::Vect<2>, rel_coord )) ((SLOM::CholeskyCovariance<2>, cov)) )
+		((SLOM::Vect<2>, rel_coord )) ((SLOM::SharedCovariance<2>, cov)) )
 double* LM_observation::eval(double ret[2]) const
 {
 	SLOM::Vect<2> landmark = pose->world2Local(*lm);
@@ -44,11 +44,12 @@ double* LM_observation::eval(double ret[2]) const
 }
 
 // Optional: A calibration matrix, for the Landmark measurements
-BUILD_RANDOMVAR(Calibration, ((SLOM::Vect<4>, mat)) ((SLOM::Vect<2>, off)));
+typedef SLOM::Matrix<2,2> Matrix2;
+BUILD_RANDOMVAR(Calibration, ((Matrix2, mat)) ((SLOM::Vect<2>, off)));
 
 BUILD_MEASUREMENT(LM_observation_Calib, 2,
 		((Pose, pose)) ((LandMark, lm)) ((Calibration, cal)),
-		((SLOM::Vect<2>, rel_coord )) ((SLOM::CholeskyCovariance<2>, cov)) )
+		((SLOM::Vect<2>, rel_coord )) ((SLOM::SharedCovariance<2>, cov)) )
 double* LM_observation_Calib::eval(double ret[2]) const
 {
 	SLOM::Vect<2> landmark = pose->world2Local(*lm);
@@ -5,20 +5,17 @@
 #include <sstream>
 #include <iomanip>
 
-#include <manifolds/Vect.h>
+#include <manifolds/Matrix.h>
 
 // calculate res-=matrix*(vec-off)*factor
 template<int n>
 void matrixSubMulDiff(double res[n],
-		const SLOM::Vect<n*n> &matrix, const SLOM::Vect<n> &vec,
+		const SLOM::Matrix<n,n> &matrix, const SLOM::Vect<n> &vec,
 		const SLOM::Vect<n> &off = SLOM::Vect<n>(), double factor=1){
-	const double *m=matrix.data;
-	for(int i=0; i<n; i++){
-		double x=factor*(vec[i] - off[i]);
-		for(int j=0; j<n; j++){
-			res[j] -= x * (*m++);
-		}
-	}
+	double x[n];
+	SLOM::MatrixKernels::sub<n>(x, vec.data, off.data);
+	for(int i=0; i<n; i++) x[i] *= factor;
+	matrix.transposedSubMul(res, x);
 }
 
 
@@ -1,13 +1,19 @@
 #include <Estimator.h>
 #include <tools/MakePose.h>
-#include <tools/CholeskyCovariance.h>
+#include <tools/NoiseModel.h>
+#include <tools/SpanningTree.h>
+#include <Multilevel.h>
+#include <Sparsifier.h>
+#include <Aggregator.h>
 
 #include <deque>
+#include <map>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <vector>
 #include <boost/ptr_container/ptr_map.hpp>
 #include <boost/version.hpp>
 #include <sys/time.h>
@@ -40,7 +46,7 @@ typedef boost::ptr_map<int, Pose> Poses;
 /// Measurement model:
 
 BUILD_MEASUREMENT(Odo, 3, ((Pose, t0)) ((Pose, t1)), 
-		((Pose_T, odo)) ((CholeskyCovariance<3>, cov)) )
+		((Pose_T, odo)) ((SharedCovariance<3>, cov)) )
 double* Odo::eval(double ret[3]) const
 {
 	Pose_T diff = t0->world2Local(*t1);
@@ -49,6 +55,37 @@ double* Odo::eval(double ret[3]) const
 	return ret+3;
 }
 
+/**
+ * Replaces the problem of e by the remaining poses and the edges between
+ * them, pose 0 stays fixed. The edges are whitened like the ones read
+ * from the file.
+ */
+template<class Edges>
+void rebuild(Estimator &e, Poses &poses, deque<Odo> &odo,
+		const map<int, Pose_T> &remaining, const Edges &edges)
+{
+	e.clear();
+	odo.clear();
+	poses.clear();
+	for(map<int, Pose_T>::const_iterator it = remaining.begin(); it != remaining.end(); ++it){
+		int id = it->first;
+		poses.insert(id, new Pose(it->second, id != 0));
+		e.insertRV(&poses[id]);
+	}
+	for(size_t k=0; k<edges.size(); k++){
+		odo.push_back(Odo(poses[edges[k].from], poses[edges[k].to], edges[k].delta,
+				CholeskyCovariance<3>(edges[k].information, CholeskyMode::CHOLESKY_FULL)));
+		e.insertMeasurement(&odo.back());
+	}
+}
+
+
+
+struct Edge {
+	int frameA, frameB;
+	Pose_T delta;
+	double information[3][3];
+};
 
 
 void outputPoses(const Poses &poses, int k){
@@ -62,17 +99,36 @@ void outputPoses(const Poses &poses, int k){
 
 int main(int argc, char** argv){
 	if(argc < 2){
-		cerr << "need input file\n";
+		cerr << "need input file [tree] [multilevel] [checkpoint] [cache] [lbfgs] [pcg] [outofcore] [sparsify] [aggregate]\n";
 		return -1;
 	}
 	ifstream logfile(argv[1]);
+	// initialize the poses along the least uncertain spanning tree,
+	// and/or solve coarse-to-fine before optimizing the whole graph,
+	// and/or resume from and save to relation2d.ckpt:
+	bool useTree = false, useMultilevel = false, useCheckpoint = false, useCache = false, useLbfgs = false, usePcg = false, useOutOfCore = false, useSparsify = false, useAggregate = false;
+	for(int k=2; k<argc; k++){
+		useTree = useTree || string(argv[k]) == "tree";
+		useMultilevel = useMultilevel || string(argv[k]) == "multilevel";
+		useCheckpoint = useCheckpoint || string(argv[k]) == "checkpoint";
+		useCache = useCache || string(argv[k]) == "cache";
+		useLbfgs = useLbfgs || string(argv[k]) == "lbfgs";
+		usePcg = usePcg || string(argv[k]) == "pcg";
+		useOutOfCore = useOutOfCore || string(argv[k]) == "outofcore";
+		useSparsify = useSparsify || string(argv[k]) == "sparsify";
+		useAggregate = useAggregate || string(argv[k]) == "aggregate";
+	}
+	const char *checkpointFile = "relation2d.ckpt";
 	
 	
-	Estimator e(Estimator::Cholesky, Estimator::GaussNewton);
+	Estimator e(usePcg ? Estimator::PCG : Estimator::Cholesky, useLbfgs ? Estimator::LBFGS : Estimator::GaussNewton);
 	Poses poses;
 	deque<Odo> odo;
+	SpanningTree<Pose_T> tree;
+	vector<Edge> edges;
 	
 	poses[0] = Pose(Pose_T(), false);
+	tree.addRoot(0);
 	
 	e.insertRV(&poses[0]);
 	
@@ -121,9 +177,55 @@ int main(int argc, char** argv){
 			odo.push_back(Odo(poses[frameA], poses[frameB], delta, 
 					CholeskyCovariance<3>(&xCov[0][0],CholeskyMode::CHOLESKY_FULL)));
 			e.insertMeasurement(&odo.back());
+			// the inverse diagonal of the information matrix approximates the covariance:
+			tree.addEdge(frameA, frameB, delta, 
+					1/xCov[RGX][RGX] + 1/xCov[RGY][RGY] + 1/xCov[RGPHI][RGPHI]);
+			Edge edge = {frameA, frameB, delta};
+			std::copy(&xCov[0][0], &xCov[0][0] + 9, &edge.information[0][0]);
+			edges.push_back(edge);
 		}
 	}
 	logfile.close();
+	if(useTree){
+		map<int, Pose_T> initial;
+		int components = tree.compose(initial);
+		for(map<int, Pose_T>::const_iterator it = initial.begin(); it != initial.end(); ++it){
+			if(poses.find(it->first) != poses.end()) poses[it->first] = it->second;
+		}
+		cout << "\nInitialized along spanning tree, " << components << " component(s)";
+	}
+	if(useMultilevel){
+		Multilevel<Pose_T> multilevel;
+		for(Poses::const_iterator it = poses.begin(); it != poses.end(); ++it){
+			multilevel.addPose(PTR_MAP_IT_KEY(it), *PTR_MAP_IT_VALUE(it), PTR_MAP_IT_KEY(it) == 0);
+		}
+		for(size_t k=0; k<edges.size(); k++){
+			multilevel.addEdge(edges[k].frameA, edges[k].frameB, edges[k].delta, &edges[k].information[0][0]);
+		}
+		cout << "\nMultilevel: " << multilevel.buildLevels() << " levels" << endl;
+		multilevel.setLogger(&cout);
+		multilevel.optimize(10, 2);
+		const map<int, Pose_T> &result = multilevel.getPoses();
+		for(map<int, Pose_T>::const_iterator it = result.begin(); it != result.end(); ++it){
+			poses[it->first] = it->second;
+		}
+	}
+	Aggregator<Pose_T> aggregator;
+	if(useAggregate){
+		// fuse parallel edges and pre-integrate odometry chains:
+		for(Poses::const_iterator it = poses.begin(); it != poses.end(); ++it){
+			aggregator.addPose(PTR_MAP_IT_KEY(it), *PTR_MAP_IT_VALUE(it), PTR_MAP_IT_KEY(it) == 0);
+		}
+		for(size_t k=0; k<edges.size(); k++){
+			aggregator.addEdge(edges[k].frameA, edges[k].frameB, edges[k].delta, &edges[k].information[0][0]);
+		}
+		int merged = aggregator.mergeParallel();
+		int integrated = aggregator.integrateChains();
+		merged += aggregator.mergeParallel();
+		cout << "\nAggregated: merged " << merged << " parallel edges, integrated " 
+		     << integrated << " chain poses" << endl;
+		rebuild(e, poses, odo, aggregator.getPoses(), aggregator.getEdges());
+	}
 	outputPoses(poses, 0);
 	
 	cout << "\nLogfile read\nInitializing" << endl;
@@ -131,23 +233,65 @@ int main(int argc, char** argv){
 	struct timeval ts, te;
 	gettimeofday(&ts,0);
 
-	e.initialize();
-	
-	
-	int kMax = 50; //TODO read from commandline
-	for(int k=1; k<=kMax; k++){
-		cout << "Step " << k << ": ";
-		double gain = e.optimizeStep();
-		
-		//outputPoses(poses, k);
-		if( 0 <= gain && gain < 1e-9) break;
+	if(useCache) e.setOrderingCache(".");
+	if(useOutOfCore) e.setOutOfCore(".");
+	bool resumed = false;
+	if(useCheckpoint){
+		ifstream checkpoint(checkpointFile, ios::binary);
+		resumed = checkpoint && e.loadCheckpoint(checkpoint);
+		cout << (resumed ? "Resumed from " : "No usable checkpoint in ") << checkpointFile << endl;
 	}
+	if(!resumed) e.initialize();
+	
+	e.setLogger(&cout);
+	int kMax = useLbfgs ? 5000 : 50; //TODO read from commandline
+	e.optimize(kMax, Estimator::Tolerances(1e-9));
 	gettimeofday(&te,0);
+	if(useCheckpoint){
+		ofstream checkpoint(checkpointFile, ios::binary);
+		if(!e.saveCheckpoint(checkpoint, true)) cerr << "Could not write " << checkpointFile << endl;
+	}
+	if(useAggregate){
+		// place the poses of the pre-integrated chains along the optimized ones:
+		map<int, Pose_T> result;
+		for(Poses::const_iterator it = poses.begin(); it != poses.end(); ++it){
+			result[PTR_MAP_IT_KEY(it)] = *PTR_MAP_IT_VALUE(it);
+		}
+		aggregator.recover(result);
+		for(map<int, Pose_T>::const_iterator it = result.begin(); it != result.end(); ++it){
+			if(poses.find(it->first) == poses.end()) poses[it->first] = it->second;
+		}
+		outputPoses(poses, 1);
+	}
 	cout << "**** Optimization Done ****" << endl;
 	
 	double dts=(te.tv_sec-ts.tv_sec)+1e-6*(te.tv_usec-ts.tv_usec);
 	cout << "TOTAL TIME= " << dts << " s." << endl;
 	
+	const StepStats &stats = e.getTotalStats();
+	for(int k=0; k<StepStats::NumPhases; k++){
+		cout << StepStats::phaseName(k) << ": " << stats.time[k] << " s" << endl;
+	}
+	cout << "evaluations: " << stats.evaluations << ", nnz(J): " << stats.nnzJ 
+	     << ", nnz(L): " << stats.nnzL << ", bytes: " << stats.bytes << endl;
+	
+	
+	if(useSparsify){
+		// sparsify the optimized graph and optimize the remaining poses again:
+		Sparsifier<Pose_T> sparsifier;
+		for(Poses::const_iterator it = poses.begin(); it != poses.end(); ++it){
+			sparsifier.addPose(PTR_MAP_IT_KEY(it), *PTR_MAP_IT_VALUE(it), PTR_MAP_IT_KEY(it) == 0);
+		}
+		for(size_t k=0; k<edges.size(); k++){
+			sparsifier.addEdge(edges[k].frameA, edges[k].frameB, edges[k].delta, &edges[k].information[0][0]);
+		}
+		// remove poses less than 1m (or 1rad) away from a neighbor:
+		int removed = sparsifier.sparsify(1.0);
+		cout << "Sparsified: removed " << removed << " of " << poses.size() << " poses" << endl;
+		rebuild(e, poses, odo, sparsifier.getPoses(), sparsifier.getEdges());
+		e.initialize();
+		e.optimize(kMax, Estimator::Tolerances(1e-9));
+	}
 	
 	cout << "Done";
 }
@@ -0,0 +1,218 @@
+#include <Estimator.h>
+#include <Consensus.h>
+#include <tools/MakePose.h>
+#include <tools/NoiseModel.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <boost/ptr_container/ptr_map.hpp>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "../tools.h"
+
+using namespace SLOM;
+
+
+using namespace std;
+
+
+/**
+ * Optimizing TORO2D .graph files distributed over several processes.
+ * The poses are split into numWorkers consecutive ranges of ids, each
+ * edge belongs to the partition of its observed pose. Poses used by
+ * several partitions are agreed on by consensus ADMM.
+ */
+
+MAKE_POSE2D(Pose, pos , orientation, )
+
+typedef boost::ptr_map<int, Pose> Poses;
+
+
+/// Measurement model:
+
+BUILD_MEASUREMENT(Odo, 3, ((Pose, t0)) ((Pose, t1)),
+		((Pose_T, odo)) ((SharedCovariance<3>, cov)) )
+double* Odo::eval(double ret[3]) const
+{
+	Pose_T diff = t0->world2Local(*t1);
+	diff.sub(ret, odo);
+	cov.apply(ret);
+	return ret+3;
+}
+
+
+struct Edge {
+	int frameA, frameB;
+	Pose_T delta;
+	double cov[3][3];
+};
+
+/**
+ * The whole graph, read by the coordinator before the workers are forked.
+ * For simplicity every worker inherits all of it, but only builds
+ * its own partition.
+ */
+struct Graph {
+	map<int, Pose_T> initial;
+	vector<Edge> edges;
+	int maxId;
+	int numWorkers;
+	int localSteps;
+
+	int owner(int id) const {
+		return (long long)id * numWorkers / (maxId + 1);
+	}
+};
+
+
+/**
+ * Reads the graph, initial poses are calculated like in relation2d.
+ */
+void readGraph(const char* file, Graph &g){
+	ifstream logfile(file);
+	g.initial[0] = Pose_T();
+
+	std::string line;
+	while(getline(logfile, line)){
+		enum Indexes { RGX, RGY, RGPHI};
+
+		istringstream inp(line);
+		string tag;
+		inp >> tag;
+		if(tag=="VERTEX" || tag=="VERTEX2") {
+			int id;
+			double xEst[3];
+			inp >> id >> xEst[RGX] >> xEst[RGY] >> xEst[RGPHI];
+			if(g.initial.find(id)==g.initial.end()){
+				g.initial[id] = Pose_T(xEst, xEst[RGPHI]);
+			}
+		} else if (tag == "EDGE" || tag == "EDGE2") {
+			Edge edge;
+			double xEst[3];
+			double (&xCov)[3][3] = edge.cov;
+			inp >> edge.frameA >> edge.frameB
+			    >> xEst[RGX] >> xEst[RGY] >> xEst[RGPHI]
+			    >> xCov[RGX][RGX] >> xCov[RGX][RGY] >> xCov[RGY][RGY]
+			    >> xCov[RGPHI][RGPHI] >> xCov[RGX][RGPHI] >> xCov[RGY][RGPHI];
+			edge.delta = Pose_T(xEst, xEst[RGPHI]);
+			if(g.initial.find(edge.frameA)==g.initial.end()){
+				if(g.initial.find(edge.frameB)==g.initial.end()){
+					g.initial[edge.frameB] = Pose_T();
+				}
+				g.initial[edge.frameA] = g.initial[edge.frameB].local2World(edge.delta);
+			}
+			g.edges.push_back(edge);
+		}
+	}
+	logfile.close();
+	g.maxId = g.initial.rbegin()->first;
+}
+
+
+int workerMain(int index, int fd, void *arg){
+	const Graph &g = *static_cast<const Graph*>(arg);
+
+	// the partitions which have a copy of each pose:
+	map<int, set<int> > holders;
+	for(map<int, Pose_T>::const_iterator it = g.initial.begin(); it != g.initial.end(); ++it){
+		holders[it->first].insert(g.owner(it->first));
+	}
+	for(size_t k=0; k<g.edges.size(); k++){
+		int w = g.owner(g.edges[k].frameA);
+		holders[g.edges[k].frameA].insert(w);
+		holders[g.edges[k].frameB].insert(w);
+	}
+
+	Estimator e(Estimator::Cholesky, Estimator::GaussNewton);
+	Poses poses;
+	deque<Odo> odo;
+
+	for(map<int, Pose_T>::const_iterator it = g.initial.begin(); it != g.initial.end(); ++it){
+		int id = it->first;
+		if(holders[id].count(index)){
+			poses.insert(id, new Pose(it->second, id != 0));
+			e.insertRV(&poses[id]);
+		}
+	}
+	for(size_t k=0; k<g.edges.size(); k++){
+		const Edge &edge = g.edges[k];
+		if(g.owner(edge.frameA) != index) continue;
+		odo.push_back(Odo(poses[edge.frameA], poses[edge.frameB], edge.delta,
+				CholeskyCovariance<3>(&edge.cov[0][0],CholeskyMode::CHOLESKY_FULL)));
+		e.insertMeasurement(&odo.back());
+	}
+
+	ConsensusWorker worker(e, fd);
+	int numBoundary = 0;
+	for(Poses::iterator it = poses.begin(); it != poses.end(); ++it){
+		if(holders[it->first].size() > 1){
+			worker.addBoundary(it->first, *it->second);
+			numBoundary++;
+		}
+	}
+	cout << "Worker " << index << ": " << poses.size() << " poses, " << odo.size()
+	     << " edges, " << numBoundary << " boundary poses" << endl;
+
+	if(!worker.run(g.localSteps)){
+		cerr << "Worker " << index << ": lost connection" << endl;
+		return 1;
+	}
+
+	std::ofstream out(make_filename("consensus",index,".pos").c_str());
+	for(Poses::const_iterator it = poses.begin(); it != poses.end(); ++it){
+		if(g.owner(it->first) != index) continue;
+		const Pose &p = *it->second;
+		out << p->pos[0] << " " << p->pos[1] << " " << p->orientation << endl;
+	}
+	return 0;
+}
+
+
+int main(int argc, char** argv){
+	if(argc < 2){
+		cerr << "usage: " << argv[0] << " file.graph [numWorkers [rho]]\n";
+		return -1;
+	}
+	Graph g;
+	g.numWorkers = argc > 2 ? atoi(argv[2]) : 2;
+	double rho = argc > 3 ? atof(argv[3]) : 1;
+	g.localSteps = 1;
+	if(g.numWorkers < 1) g.numWorkers = 1;
+	readGraph(argv[1], g);
+
+	cout << "Logfile read, starting " << g.numWorkers << " workers" << endl;
+
+	struct timeval ts, te;
+	gettimeofday(&ts,0);
+
+	vector<int> fds;
+	vector<pid_t> pids;
+	if(!ConsensusCoordinator::spawn(g.numWorkers, workerMain, &g, fds, pids)){
+		cerr << "could not start workers\n";
+		return -1;
+	}
+	ConsensusCoordinator coordinator(fds, rho);
+	ConsensusCoordinator::Stats stats;
+	bool ok = coordinator.run(3000, 1e-6, stats);
+	for(size_t k=0; k<fds.size(); k++) close(fds[k]);
+	ok = ConsensusCoordinator::join(pids) && ok;
+
+	gettimeofday(&te,0);
+	cout << "**** Optimization " << (ok ? "Done" : "Failed") << " ****" << endl;
+	cout << "Iterations: " << stats.iterations << ", RSS: " << stats.rss
+	     << ", primal: " << stats.primal << ", dual: " << stats.dual << ", rho: " << stats.rho
+	     << (stats.converged ? ", converged" : "") << endl;
+
+	double dts=(te.tv_sec-ts.tv_sec)+1e-6*(te.tv_usec-ts.tv_usec);
+	cout << "TOTAL TIME= " << dts << " s." << endl;
+
+	return ok ? 0 : 1;
+}
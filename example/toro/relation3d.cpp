@@ -1,14 +1,18 @@
 #include <Estimator.h>
 #include <tools/MakePose.h>
-#include <tools/CholeskyCovariance.h>
+#include <tools/NoiseModel.h>
+#include <tools/SpanningTree.h>
 
 #include <algorithm>
 #include <deque>
+#include <map>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <cstdlib>
 #include <boost/ptr_container/ptr_map.hpp>
 #include <boost/version.hpp>
 #include <sys/time.h>
@@ -60,7 +64,9 @@ void readPose(Pose_T & pose, istream & inp){
 	double phi, theta, psi;
 	inp >> phi >> theta >> psi;
 	
-	euler2quaternion(pose.orientation.quat, phi, theta, psi);
+	Quaternion q;
+	euler2quaternion(q, phi, theta, psi);
+	pose.orientation = SO3(q);
 }
 
 
@@ -80,22 +86,57 @@ typedef boost::ptr_map<int, Pose> Poses;
 /// Measurement model:
 
 BUILD_MEASUREMENT(Odo, 6, ((Pose, t0)) ((Pose, t1)), 
-		((Pose_T, odo)) /* ((CholeskyCovariance<3>, cov)) */)
+		((Pose_T, odo)) ((IdentityCovariance<6>, cov)) )
 double* Odo::eval(double ret[6]) const
 {
 	Pose_T diff = t0->world2Local(*t1);
 	odo.sub(ret, diff); 
-	//cov.apply(ret);
+	cov.apply(ret); // information matrix of the logfile is ignored
 	return ret+6;
 }
 
 
 
+/**
+ * A parsed line of the logfile.
+ */
+struct Record {
+	enum Kind {NONE, VERTEX, EDGE} kind;
+	int a, b;      // id of a vertex, or frameA and frameB of an edge
+	Pose_T pose;   // pose of a vertex, or delta of an edge
+};
+
+/**
+ * Parses lines into records, lines are independent so this can run in parallel.
+ */
+struct ParseBody {
+	const vector<string> *lines;
+	vector<Record> *records;
+	void operator()(int k) const {
+		istringstream inp((*lines)[k]);
+		Record &rec = (*records)[k];
+		rec.kind = Record::NONE;
+		string tag;
+		inp >> tag;
+		if(tag=="VERTEX" || tag=="VERTEX3") {
+			rec.kind = Record::VERTEX;
+			inp >> rec.a;
+			readPose(rec.pose, inp);
+		} else if (tag == "EDGE" || tag == "EDGE3") {
+			//EDGE3 observed_vertex_id observing_vertex_id forward sideward rotate inf_ff inf_fs inf_ss inf_rr inf_fr inf_sr 
+			rec.kind = Record::EDGE;
+			inp >> rec.a >> rec.b;
+			readPose(rec.pose, inp);
+		}
+	}
+};
+
+
 void outputPoses(const Poses &poses, int k){
 	std::ofstream out(make_filename("output",k,".pos").c_str());
 	for (Poses::const_iterator it = poses.begin(); it != poses.end(); ++it) {
 		out << PTR_MAP_IT_VALUE(it)->pos[0] << " " << PTR_MAP_IT_VALUE(it)->pos[1] << " " << PTR_MAP_IT_VALUE(it)->pos[2] << " ";
-		const Quaternion &q = PTR_MAP_IT_VALUE(it)->orientation.quat;
+		const Quaternion &q = PTR_MAP_IT_VALUE(it)->orientation.quaternion();
 		out << q.w << " " << q.x << " " << q.y << " " << q.z << endl;
 	}
 	out.close();
@@ -103,45 +144,48 @@ void outputPoses(const Poses &poses, int k){
 
 int main(int argc, char** argv){
 	if(argc < 2){
-		cerr << "need input file\n";
+		cerr << "need input file [number of threads [tree]]\n";
 		return -1;
 	}
 	ifstream logfile(argv[1]);
 	
 	
 	Estimator e(Estimator::Cholesky, Estimator::GaussNewton, 10);
+	if(argc > 2) e.setNumThreads(atoi(argv[2]));
+	// initialize the poses along the spanning tree with the fewest edges:
+	bool useTree = argc > 3 && string(argv[3]) == "tree";
 	Poses poses;
 	deque<Odo> odo;
+	SpanningTree<Pose_T> tree;
 		
+	vector<string> lines;
 	std::string line;
+	while(getline(logfile, line)){
+		lines.push_back(line);
+	}
+	logfile.close();
 	
+	// parse all lines using the estimator's threads, then insert them in order:
+	vector<Record> records(lines.size());
+	ParseBody parse = {&lines, &records};
+	e.getThreadPool().parallelFor(lines.size(), parse, 1024);
 	
 	bool firstPose = true;
-	while(getline(logfile, line)){
-		enum Indexes { RGX, RGY, RGPHI};
-
-		istringstream inp(line);
-		string tag;
-		inp >> tag;
-		if(tag=="VERTEX" || tag=="VERTEX3") {
+	for(size_t r=0; r<records.size(); r++){
+		const Record &rec = records[r];
+		if(rec.kind == Record::VERTEX) {
 			//if(!firstPose) continue;
-			int id;
-			inp >> id;
+			int id = rec.a;
 			//check if pose already included:
 			if(poses.find(id)!=poses.end()) continue;
-			Pose_T pose;
-			readPose(pose, inp);
-			poses.insert(id, new Pose(pose, !firstPose));  // TODO poses[id] = Pose(pose);
+			poses.insert(id, new Pose(rec.pose, !firstPose));  // TODO poses[id] = Pose(pose);
 			e.insertRV(&poses[id]);
+			if(firstPose) tree.addRoot(id, rec.pose);
 			firstPose = false;
 
-		} else if (tag == "EDGE" || tag == "EDGE3") {
-			int frameA, frameB;
-			//EDGE3 observed_vertex_id observing_vertex_id forward sideward rotate inf_ff inf_fs inf_ss inf_rr inf_fr inf_sr 
-			inp >> frameA >> frameB;
-			
-			Pose_T delta;
-			readPose(delta, inp);
+		} else if (rec.kind == Record::EDGE) {
+			int frameA = rec.a, frameB = rec.b;
+			const Pose_T &delta = rec.pose;
 
 			if(poses.find(frameA)==poses.end()){
 				if(poses.find(frameB)==poses.end()){
@@ -155,11 +199,19 @@ int main(int argc, char** argv){
 				//assert(poses.size()==(unsigned)frameA+1);
 				e.insertRV(&poses[frameA]);
 			}
-			odo.push_back(Odo(poses[frameA], poses[frameB], delta));
+			odo.push_back(Odo(poses[frameA], poses[frameB], delta, IdentityCovariance<6>()));
 			e.insertMeasurement(&odo.back());
+			tree.addEdge(frameA, frameB, delta);
 		}
 	}
-	logfile.close();
+	if(useTree){
+		map<int, Pose_T> initial;
+		int components = tree.compose(initial);
+		for(map<int, Pose_T>::const_iterator it = initial.begin(); it != initial.end(); ++it){
+			if(poses.find(it->first) != poses.end()) poses[it->first] = it->second;
+		}
+		cout << "\nInitialized along spanning tree, " << components << " component(s)";
+	}
 	outputPoses(poses, 0);
 	
 	cout << "\nLogfile read\nInitializing" << endl;
@@ -168,6 +220,7 @@ int main(int argc, char** argv){
 	gettimeofday(&ts,0);
 	
 	e.initialize();
+	e.setLogger(&cout);
 
 	int kMax = 50; //TODO read from commandline
 	for(int k=1; k<=kMax; k++){
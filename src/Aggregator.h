@@ -0,0 +1,245 @@
+#ifndef AGGREGATOR_H_
+#define AGGREGATOR_H_
+
+#include "tools/PoseGraph.h"
+
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+
+namespace SLOM {
+
+/**
+ * Combines redundant edges of a pose graph before it is optimized.
+ *
+ * mergeParallel() fuses all edges between the same two poses into one
+ * edge, weighted by their information. integrateChains() pre-integrates
+ * odometry chains: a pose which is only connected to its predecessor and
+ * its successor is removed and its two edges are composed into one, with
+ * the first order propagated covariance. Neither changes the solution up
+ * to linearization, but the Jacobian gets fewer rows and columns.
+ * After optimizing the remaining poses, recover() places the removed
+ * poses between the optimized ends of their chains.
+ *
+ * Poses and edges are as described for PoseGraphEdge.
+ */
+template<typename Pose_T>
+class Aggregator
+{
+public:
+	enum {DOF = Pose_T::DOF};
+
+	typedef PoseGraphEdge<Pose_T> Edge;
+
+	/**
+	 * Adds a pose with its initial value. Kept poses are never removed,
+	 * e.g. because other measurements refer to them.
+	 */
+	void addPose(int id, const Pose_T &pose, bool keep=false){
+		poses[id] = pose;
+		if(keep) keptPoses.insert(id);
+	}
+
+	/**
+	 * Adds the edge (from, to, delta, information), see PoseGraphEdge.
+	 * Both poses must have been added before.
+	 */
+	void addEdge(int from, int to, const Pose_T &delta, const double *information){
+		edges.push_back(Edge(from, to, delta, information));
+	}
+
+	/**
+	 * Fuses the edges between the same two poses, in either direction.
+	 * Returns the number of removed edges.
+	 */
+	int mergeParallel();
+
+	/**
+	 * Removes each pose which is not kept and has exactly two edges to two
+	 * different poses. Whole chains are collapsed into one edge.
+	 * Returns the number of removed poses.
+	 */
+	int integrateChains();
+
+	/**
+	 * The remaining poses.
+	 */
+	const std::map<int, Pose_T>& getPoses() const {
+		return poses;
+	}
+
+	/**
+	 * The edges between the remaining poses.
+	 */
+	const std::vector<Edge>& getEdges() const {
+		return edges;
+	}
+
+	/**
+	 * Adds the poses removed by integrateChains() to result, which has to
+	 * contain the remaining poses, e.g. after they have been optimized.
+	 * In the reverse order of their removal, each pose is placed at the
+	 * optimum of its two edges with their other ends fixed, so the
+	 * correction between the ends of a chain is spread along it.
+	 */
+	void recover(std::map<int, Pose_T> &result) const;
+
+private:
+	/**
+	 * A pose removed by integrateChains() with its edges
+	 * first.from->pose->second.to.
+	 */
+	struct Removed {
+		int pose;
+		Edge first, second;
+	};
+
+	/**
+	 * Gauss-Newton iterations and step norm to place a removed pose.
+	 */
+	enum {MAX_ITERATIONS = 10};
+	static const double STEP_TOLERANCE;
+
+	std::map<int, Pose_T> poses;
+	std::set<int> keptPoses;
+	std::vector<Edge> edges;
+	std::vector<Removed> removed;
+};
+
+
+template<typename Pose_T>
+const double Aggregator<Pose_T>::STEP_TOLERANCE = 1e-9;
+
+template<typename Pose_T>
+void Aggregator<Pose_T>::recover(std::map<int, Pose_T> &result) const {
+	for(typename std::vector<Removed>::const_reverse_iterator r = removed.rbegin(); r != removed.rend(); r++){
+		const Pose_T a = result[r->first.from], b = result[r->second.to];
+		Pose_T v = a.local2World(r->first.delta);
+		double W[2][DOF*DOF];
+		PoseGraph::weight<DOF>(r->first.information, W[0]);
+		PoseGraph::weight<DOF>(r->second.information, W[1]);
+		for(int it=0; it<MAX_ITERATIONS; it++){
+			double J[2][DOF*DOF], res[2][DOF];
+			PoseGraph::jacobian(PoseGraph::LocalTo<Pose_T>(a), v, r->first.delta, J[0]);
+			a.world2Local(v).sub(res[0], r->first.delta);
+			PoseGraph::jacobian(PoseGraph::LocalFrom<Pose_T>(b), v, r->second.delta, J[1]);
+			v.world2Local(b).sub(res[1], r->second.delta);
+			// H = sum J^T W J, g = sum J^T W res
+			double H[DOF*DOF], g[DOF];
+			std::fill_n(H, (int)DOF*DOF, 0.0);
+			std::fill_n(g, (int)DOF, 0.0);
+			for(int e=0; e<2; e++){
+				for(int i=0; i<DOF; i++){
+					for(int k=0; k<DOF; k++){
+						for(int l=0; l<DOF; l++){
+							double JW = J[e][k*DOF+i] * W[e][k*DOF+l];
+							g[i] += JW * res[e][l];
+							for(int j=0; j<DOF; j++) H[i*DOF+j] += JW * J[e][l*DOF+j];
+						}
+					}
+				}
+			}
+			if(!PoseGraph::invert(H, DOF)) break;
+			double step[DOF], norm = 0;
+			for(int i=0; i<DOF; i++){
+				step[i] = 0;
+				for(int j=0; j<DOF; j++) step[i] -= H[i*DOF+j] * g[j];
+				norm += step[i]*step[i];
+			}
+			v.add(step, 1);
+			if(norm < STEP_TOLERANCE*STEP_TOLERANCE) break;
+		}
+		result[r->pose] = v;
+	}
+}
+
+template<typename Pose_T>
+int Aggregator<Pose_T>::mergeParallel(){
+	// the first edge of each unordered pair, later ones are fused into it:
+	std::map<std::pair<int, int>, int> first;
+	std::vector<Edge> merged;
+	for(size_t k=0; k<edges.size(); k++){
+		const Edge &e = edges[k];
+		std::pair<int, int> key(std::min(e.from, e.to), std::max(e.from, e.to));
+		typename std::map<std::pair<int, int>, int>::const_iterator it = first.find(key);
+		if(it == first.end()){
+			first[key] = merged.size();
+			merged.push_back(e);
+			continue;
+		}
+		Edge &target = merged[it->second];
+		Edge same;
+		if(e.from == target.from){
+			same = e;
+		} else {
+			e.reverse(same);
+		}
+		Edge::fuse(target, same, target);
+	}
+	int count = edges.size() - merged.size();
+	edges.swap(merged);
+	return count;
+}
+
+template<typename Pose_T>
+int Aggregator<Pose_T>::integrateChains(){
+	std::map<int, std::set<int> > incident;
+	for(size_t k=0; k<edges.size(); k++){
+		incident[edges[k].from].insert(k);
+		incident[edges[k].to].insert(k);
+	}
+	std::vector<char> removedEdges(edges.size(), false);
+	int count = 0;
+	for(typename std::map<int, Pose_T>::iterator it = poses.begin(); it != poses.end(); ){
+		int v = it->first;
+		const std::set<int> &inc = incident[v];
+		if(keptPoses.count(v) || inc.size() != 2){
+			++it;
+			continue;
+		}
+		int edgeIds[2] = {*inc.begin(), *inc.rbegin()};
+		// orient the edges as a->v and v->b:
+		Edge first, second;
+		if(edges[edgeIds[0]].to == v) first = edges[edgeIds[0]];
+		else edges[edgeIds[0]].reverse(first);
+		if(edges[edgeIds[1]].from == v) second = edges[edgeIds[1]];
+		else edges[edgeIds[1]].reverse(second);
+		if(first.from == v || second.to == v || first.from == second.to){
+			++it;
+			continue;
+		}
+
+		Edge combined;
+		Edge::compose(first, second, combined);
+		Removed r;
+		r.pose = v;
+		r.first = first;
+		r.second = second;
+		removed.push_back(r);
+
+		for(int j=0; j<2; j++){
+			incident[edges[edgeIds[j]].from].erase(edgeIds[j]);
+			incident[edges[edgeIds[j]].to].erase(edgeIds[j]);
+			removedEdges[edgeIds[j]] = true;
+		}
+		edges.push_back(combined);
+		removedEdges.push_back(false);
+		incident[combined.from].insert(edges.size()-1);
+		incident[combined.to].insert(edges.size()-1);
+		incident.erase(v);
+		poses.erase(it++);
+		count++;
+	}
+
+	std::vector<Edge> remaining;
+	for(size_t k=0; k<edges.size(); k++){
+		if(!removedEdges[k]) remaining.push_back(edges[k]);
+	}
+	edges.swap(remaining);
+	return count;
+}
+
+}  // namespace SLOM
+
+#endif /*AGGREGATOR_H_*/
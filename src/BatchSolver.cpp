@@ -0,0 +1,100 @@
+#include "BatchSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SLOM {
+
+
+BatchSolver::BatchSolver(Estimator::Algorithm alg, double lamda0, Estimator::Solver solver) :
+	algorithm(alg), solver(solver), lamda0(lamda0), maxIterations(50), minGain(1e-9),
+	pool(new ThreadPool())
+{
+	createEstimators();
+}
+
+BatchSolver::~BatchSolver(){
+	deleteEstimators();
+	delete pool;
+}
+
+
+void BatchSolver::setNumThreads(int n, bool pinThreads){
+	deleteEstimators();
+	pool->resize(n-1, pinThreads);
+	createEstimators();
+}
+
+void BatchSolver::createEstimators(){
+	estimators.resize(pool->getNumThreads());
+	for(size_t t=0; t<estimators.size(); t++){
+		estimators[t] = new Estimator(solver, algorithm, lamda0);
+	}
+}
+
+void BatchSolver::deleteEstimators(){
+	for(size_t t=0; t<estimators.size(); t++){
+		delete estimators[t];
+	}
+	estimators.clear();
+}
+
+
+void BatchSolver::solveOne(const Problem &problem, Stats &stats){
+	Estimator &e = *estimators[pool->threadIndex()];
+	e.clear();
+	for(size_t v=0; v<problem.variables.size(); v++){
+		e.insertRV(problem.variables[v]);
+	}
+	for(size_t m=0; m<problem.measurements.size(); m++){
+		e.insertMeasurement(problem.measurements[m]);
+	}
+	e.setLamda(lamda0);
+	stats.reused = e.initialize();
+	Estimator::StopReason reason = e.optimize(maxIterations, Estimator::Tolerances(minGain));
+	stats.iterations = e.getIterations();
+	stats.converged = reason != Estimator::MaxIterations;
+	// a negative RSS marks a rejected step, its absolute value is still valid:
+	stats.rss = std::abs(e.getLastRSS());
+}
+
+
+/**
+ * Orders problems by size, so problems of the same shape are likely 
+ * solved one after another by the same thread.
+ */
+struct ProblemSizeLess {
+	const std::vector<BatchSolver::Problem> *problems;
+	bool operator()(int a, int b) const {
+		const BatchSolver::Problem &pa = (*problems)[a], &pb = (*problems)[b];
+		if(pa.variables.size() != pb.variables.size()) 
+			return pa.variables.size() < pb.variables.size();
+		return pa.measurements.size() < pb.measurements.size();
+	}
+};
+
+struct BatchSolver::SolveBody {
+	BatchSolver *solver;
+	const std::vector<Problem> *problems;
+	const std::vector<int> *order;
+	std::vector<Stats> *stats;
+	void operator()(int k) const {
+		int p = (*order)[k];
+		solver->solveOne((*problems)[p], (*stats)[p]);
+	}
+};
+
+void BatchSolver::solve(const std::vector<Problem> &problems, std::vector<Stats> &stats){
+	stats.resize(problems.size());
+	std::vector<int> order(problems.size());
+	for(size_t k=0; k<order.size(); k++) order[k] = k;
+	ProblemSizeLess less = {&problems};
+	std::stable_sort(order.begin(), order.end(), less);
+	
+	SolveBody body = {this, &problems, &order, &stats};
+	int grain = std::max<int>(1, problems.size() / (8*pool->getNumThreads()));
+	pool->parallelFor(problems.size(), body, grain);
+}
+
+
+}  // namespace SLOM
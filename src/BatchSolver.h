@@ -0,0 +1,78 @@
+#ifndef BATCHSOLVER_H_
+#define BATCHSOLVER_H_
+
+#include "Estimator.h"
+#include "tools/ThreadPool.h"
+
+#include <vector>
+
+namespace SLOM {
+
+/**
+ * Solves many small, independent problems concurrently.
+ * Each thread owns an Estimator which is reused for all problems it 
+ * solves, so problems of the same shape share one workspace.
+ * Problems are sorted by size before they are scheduled, to make
+ * consecutive problems of the same shape likely.
+ */
+class BatchSolver
+{
+public:
+	/**
+	 * The variables and measurements of one problem. Like for Estimator
+	 * the user is responsible for data holding. Problems must not share
+	 * variables, and each problem should be solved only once, as its 
+	 * measurements register themselves at the variables.
+	 */
+	struct Problem {
+		std::vector<IRVWrapper*> variables;
+		std::vector<IMeasurement*> measurements;
+	};
+	
+	struct Stats {
+		double rss;          // residual sum of squares of the solution
+		int iterations;      // number of calls to optimizeStep()
+		bool converged;      // the relative RSS decrease dropped below minGain
+		bool reused;         // the workspace of a previous problem was reused
+	};
+	
+	BatchSolver(Estimator::Algorithm alg=Estimator::GaussNewton, double lamda0=1e-3,
+			Estimator::Solver solver=Estimator::Cholesky);
+	~BatchSolver();
+	
+	/**
+	 * Number of problems solved concurrently, including the calling thread.
+	 */
+	void setNumThreads(int n, bool pinThreads=false);
+	
+	void setMaxIterations(int k) { maxIterations = k; }
+	void setMinGain(double g) { minGain = g; }
+	
+	/**
+	 * Solves all problems, stats[k] is set for problems[k].
+	 */
+	void solve(const std::vector<Problem> &problems, std::vector<Stats> &stats);
+	
+private:
+	Estimator::Algorithm algorithm;
+	Estimator::Solver solver;
+	double lamda0;
+	int maxIterations;
+	double minGain;
+	
+	ThreadPool *pool;
+	std::vector<Estimator*> estimators; // one for each thread of pool
+	
+	struct SolveBody;
+	void solveOne(const Problem &problem, Stats &stats);
+	void createEstimators();
+	void deleteEstimators();
+	
+	// not copyable:
+	BatchSolver(const BatchSolver&);
+	BatchSolver& operator=(const BatchSolver&);
+};
+
+}  // namespace SLOM
+
+#endif /*BATCHSOLVER_H_*/
@@ -0,0 +1,257 @@
+#include "Consensus.h"
+
+#include <map>
+#include <cmath>
+#include <cerrno>
+#include <cstdio>
+#include <numeric>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+namespace SLOM {
+
+
+/**
+ * Writes len bytes, retrying on partial writes and interrupts.
+ * Uses send() to avoid SIGPIPE if the peer is gone.
+ */
+static bool writeAll(int fd, const void *buf, size_t len){
+	const char *p = static_cast<const char*>(buf);
+	while(len > 0){
+		ssize_t ret = send(fd, p, len, MSG_NOSIGNAL);
+		if(ret < 0){
+			if(errno == EINTR) continue;
+			return false;
+		}
+		p += ret; len -= ret;
+	}
+	return true;
+}
+
+/**
+ * Reads exactly len bytes, returns false on errors and end of file.
+ */
+static bool readAll(int fd, void *buf, size_t len){
+	char *p = static_cast<char*>(buf);
+	while(len > 0){
+		ssize_t ret = read(fd, p, len);
+		if(ret < 0){
+			if(errno == EINTR) continue;
+			return false;
+		}
+		if(ret == 0) return false;
+		p += ret; len -= ret;
+	}
+	return true;
+}
+
+
+/*
+ * Protocol, all values in host byte order:
+ * Worker -> coordinator once: int count, then count pairs of int (id, DOF).
+ * Coordinator -> worker once: double rho.
+ * Each iteration, worker -> coordinator: double rss, double primal^2,
+ *   then $x \boxminus z + u$ of each boundary variable.
+ * Coordinator -> worker: double go (0 to stop), double rho, then the
+ *   update of z of each boundary variable.
+ */
+
+ConsensusWorker::ConsensusWorker(Estimator &estimator, int fd) :
+	estimator(estimator), fd(fd)
+{
+}
+
+ConsensusWorker::~ConsensusWorker(){
+	for(size_t k=0; k<boundaries.size(); k++){
+		delete boundaries[k];
+	}
+}
+
+
+bool ConsensusWorker::run(int localSteps){
+	std::vector<int> header(1, boundaries.size());
+	int dim = 0;
+	for(size_t k=0; k<boundaries.size(); k++){
+		header.push_back(boundaries[k]->id);
+		header.push_back(boundaries[k]->getDOF());
+		dim += boundaries[k]->getDOF();
+	}
+	if(!writeAll(fd, &header[0], header.size()*sizeof(int))) return false;
+	double rho;
+	if(!readAll(fd, &rho, sizeof(double))) return false;
+	for(size_t k=0; k<boundaries.size(); k++){
+		boundaries[k]->setRho(rho);
+	}
+
+	estimator.initialize();
+	std::vector<double> out(2+dim), in(2+dim), penalty(dim);
+	double primal = 0;
+	for(;;){
+		for(int s=0; s<localSteps; s++){
+			estimator.optimizeStep();
+		}
+		// RSS of the own measurements: remove the consensus penalties
+		double rss = std::abs(estimator.getLastRSS());
+		double *p = &penalty[0];
+		for(size_t k=0; k<boundaries.size(); k++){
+			p = boundaries[k]->eval(p);
+		}
+		rss -= std::inner_product(penalty.begin(), penalty.end(), penalty.begin(), 0.0);
+
+		out[0] = rss;
+		out[1] = primal;
+		double *d = &out[2];
+		for(size_t k=0; k<boundaries.size(); k++){
+			d = boundaries[k]->deviation(d);
+		}
+		if(!writeAll(fd, &out[0], out.size()*sizeof(double))) return false;
+		if(!readAll(fd, &in[0], in.size()*sizeof(double))) return false;
+
+		primal = 0;
+		const double *delta = &in[0] + 2;
+		for(size_t k=0; k<boundaries.size(); k++){
+			primal += boundaries[k]->update(delta);
+			if(in[1] != rho) boundaries[k]->setRho(in[1]);
+			delta += boundaries[k]->getDOF();
+		}
+		rho = in[1];
+		if(in[0] == 0){
+			for(size_t k=0; k<boundaries.size(); k++){
+				boundaries[k]->finish();
+			}
+			return true;
+		}
+		// the penalties changed:
+		estimator.invalidateResidual();
+	}
+}
+
+
+bool ConsensusCoordinator::run(int maxIterations, double tolerance, Stats &stats){
+	int numWorkers = fds.size();
+
+	std::map<int, Shared> shared;
+	std::vector<int> dims(numWorkers, 0);
+	for(int w=0; w<numWorkers; w++){
+		int count;
+		if(!readAll(fds[w], &count, sizeof(int)) || count < 0) return false;
+		std::vector<int> header(2*count);
+		if(count > 0 && !readAll(fds[w], &header[0], header.size()*sizeof(int))) return false;
+		for(int k=0; k<count; k++){
+			int id = header[2*k], dof = header[2*k+1];
+			std::map<int, Shared>::iterator it = shared.find(id);
+			if(it == shared.end()){
+				it = shared.insert(std::make_pair(id, Shared())).first;
+				it->second.dof = dof;
+			} else if(it->second.dof != dof){
+				return false;
+			}
+			it->second.copies.push_back(std::make_pair(w, dims[w]));
+			dims[w] += dof;
+		}
+	}
+
+	for(int w=0; w<numWorkers; w++){
+		if(!writeAll(fds[w], &rho, sizeof(double))) return false;
+	}
+
+	std::vector<std::vector<double> > in(numWorkers), out(numWorkers);
+	for(int w=0; w<numWorkers; w++){
+		in[w].resize(2+dims[w]);
+		out[w].resize(2+dims[w]);
+	}
+	std::vector<double> mean;
+
+	stats.converged = false;
+	double lastRSS = -1;
+	for(stats.iterations=1; ; stats.iterations++){
+		stats.rss = 0;
+		double primal = 0, dual = 0;
+		for(int w=0; w<numWorkers; w++){
+			if(!readAll(fds[w], &in[w][0], in[w].size()*sizeof(double))) return false;
+			stats.rss += in[w][0];
+			primal += in[w][1];
+		}
+		// the update of z is the mean deviation of all copies:
+		for(std::map<int, Shared>::const_iterator it = shared.begin(); it != shared.end(); it++){
+			const Shared &s = it->second;
+			mean.assign(s.dof, 0);
+			for(size_t c=0; c<s.copies.size(); c++){
+				const double *d = &in[s.copies[c].first][2 + s.copies[c].second];
+				for(int k=0; k<s.dof; k++) mean[k] += d[k];
+			}
+			for(int k=0; k<s.dof; k++){
+				mean[k] /= s.copies.size();
+				dual += s.copies.size() * mean[k]*mean[k];
+			}
+			for(size_t c=0; c<s.copies.size(); c++){
+				std::copy(mean.begin(), mean.end(), &out[s.copies[c].first][2 + s.copies[c].second]);
+			}
+		}
+		stats.primal = std::sqrt(primal);
+		stats.dual = rho * std::sqrt(dual);
+		stats.rho = rho;
+		// the primal residual is reported one iteration late:
+		stats.converged = stats.iterations > 1 && stats.primal < tolerance && stats.dual < tolerance
+				&& std::abs(lastRSS - stats.rss) <= tolerance * stats.rss;
+		lastRSS = stats.rss;
+		bool stop = stats.converged || stats.iterations >= maxIterations;
+		if(adaptiveRho && stats.iterations > 1){
+			if(stats.primal > 10*stats.dual){
+				rho *= 2;
+			} else if(stats.dual > 10*stats.primal){
+				rho /= 2;
+			}
+		}
+		for(int w=0; w<numWorkers; w++){
+			out[w][0] = stop ? 0 : 1;
+			out[w][1] = rho;
+			if(!writeAll(fds[w], &out[w][0], out[w].size()*sizeof(double))) return false;
+		}
+		if(stop) return true;
+	}
+}
+
+
+bool ConsensusCoordinator::spawn(int numWorkers, WorkerMain workerMain, void *arg,
+		std::vector<int> &fds, std::vector<pid_t> &pids)
+{
+	for(int k=0; k<numWorkers; k++){
+		int sv[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return false;
+		pid_t pid = fork();
+		if(pid < 0){
+			close(sv[0]); close(sv[1]);
+			return false;
+		}
+		if(pid == 0){
+			close(sv[0]);
+			for(size_t j=0; j<fds.size(); j++) close(fds[j]);
+			int ret = workerMain(k, sv[1], arg);
+			close(sv[1]);
+			fflush(0);
+			_exit(ret);
+		}
+		close(sv[1]);
+		fds.push_back(sv[0]);
+		pids.push_back(pid);
+	}
+	return true;
+}
+
+
+bool ConsensusCoordinator::join(const std::vector<pid_t> &pids){
+	bool ok = true;
+	for(size_t k=0; k<pids.size(); k++){
+		int status;
+		while(waitpid(pids[k], &status, 0) < 0){
+			if(errno != EINTR) return false;
+		}
+		ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+	return ok;
+}
+
+}  // namespace SLOM
@@ -0,0 +1,202 @@
+#ifndef CONSENSUS_H_
+#define CONSENSUS_H_
+
+#include "Estimator.h"
+
+#include <deque>
+#include <vector>
+#include <cmath>
+
+#include <sys/types.h>
+
+namespace SLOM {
+
+/**
+ * Distributed optimization of a problem which is partitioned over several
+ * processes. Each process owns an Estimator with a part of the variables
+ * and measurements and runs a ConsensusWorker. Variables which appear in
+ * several partitions (boundary variables) are kept as local copies, which
+ * are pulled towards a common consensus value by consensus ADMM:
+ *
+ * Each worker minimizes its own measurements plus the penalty
+ * $\rho |x \boxminus z + u|^2$ for each boundary variable x with consensus z
+ * and scaled dual variable u. The coordinator averages
+ * $x \boxminus z + u$ over all copies of a variable, which gives the update
+ * of z, then each worker updates its dual variables. The coordinator also
+ * chooses $\rho$, balancing the primal and dual residuals.
+ *
+ * Workers and coordinator communicate via sockets, e.g. Unix-domain socket
+ * pairs created by ConsensusCoordinator::spawn().
+ */
+class ConsensusWorker
+{
+public:
+	/**
+	 * estimator must already contain the variables and measurements of
+	 * this partition. fd is the socket connected to the coordinator.
+	 */
+	ConsensusWorker(Estimator &estimator, int fd);
+	~ConsensusWorker();
+
+	/**
+	 * Declares var as boundary variable with the global id.
+	 * All copies of a boundary variable must start with the same value.
+	 * var must have been inserted into the estimator before.
+	 */
+	template<typename RV>
+	void addBoundary(int id, RVWrapper<RV> &var){
+		Boundary<RV> *b = new Boundary<RV>(id, var);
+		boundaries.push_back(b);
+		estimator.insertMeasurement(b);
+	}
+
+	/**
+	 * Initializes the estimator and iterates until the coordinator stops.
+	 * Each iteration does localSteps calls to optimizeStep().
+	 * At the end the boundary variables are set to their consensus value.
+	 * Returns false on communication errors.
+	 */
+	bool run(int localSteps=1);
+
+private:
+	/**
+	 * The consensus penalty of a boundary variable, a measurement of
+	 * the local copy.
+	 */
+	struct IBoundary : public IMeasurement {
+		int id;
+		IBoundary(int id) : id(id) {}
+		virtual ~IBoundary() {}
+		virtual int getDOF() const = 0;
+		// stores $x \boxminus z + u$ in d, returns d+DOF
+		virtual double* deviation(double *d) const = 0;
+		// z = z \boxplus delta, u += x \boxminus z; returns |x \boxminus z|^2
+		virtual double update(const double *delta) = 0;
+		// changes rho, rescaling u
+		virtual void setRho(double rho) = 0;
+		// sets x = z
+		virtual void finish() = 0;
+	};
+
+	template<typename RV>
+	struct Boundary : public IBoundary {
+		enum {DOF = RV::DOF};
+		RVWrapper<RV> &var;
+		RV consensus;
+		double dual[DOF];
+		double sqrtRho;
+
+		Boundary(int id, RVWrapper<RV> &var) :
+			IBoundary(id), var(var), consensus(*var), sqrtRho(1)
+		{
+			std::fill_n(dual, (int)DOF, 0);
+		}
+		double* eval(double *ret) const {
+			deviation(ret);
+			for(int k=0; k<DOF; k++) ret[k] *= sqrtRho;
+			return ret+DOF;
+		}
+		int getDOF() const { return DOF; }
+		double* deviation(double *d) const {
+			var->sub(d, consensus);
+			for(int k=0; k<DOF; k++) d[k] += dual[k];
+			return d+DOF;
+		}
+		double update(const double *delta) {
+			consensus.add(delta);
+			double r[DOF], sum = 0;
+			var->sub(r, consensus);
+			for(int k=0; k<DOF; k++){
+				dual[k] += r[k];
+				sum += r[k]*r[k];
+			}
+			return sum;
+		}
+		void setRho(double rho) {
+			double scale = sqrtRho*sqrtRho / rho;
+			for(int k=0; k<DOF; k++) dual[k] *= scale;
+			sqrtRho = std::sqrt(rho);
+		}
+		void finish() {
+			var = consensus;
+		}
+	private:
+		int getDim() const { return DOF; }
+		int getDepend() const { return DOF; }
+		int registerVariables() const { return var.registerMeasurement(this); }
+	};
+
+	Estimator &estimator;
+	int fd;
+	std::deque<IBoundary*> boundaries;
+
+	// not copyable:
+	ConsensusWorker(const ConsensusWorker&);
+	ConsensusWorker& operator=(const ConsensusWorker&);
+};
+
+
+/**
+ * Collects the boundary variables of all workers, calculates their
+ * consensus and decides when to stop.
+ */
+class ConsensusCoordinator
+{
+public:
+	struct Stats {
+		int iterations;
+		double rss;      // sum of the workers' RSS, without consensus penalties
+		double primal;   // $\sqrt{\sum |x \boxminus z|^2}$ over all copies
+		double dual;     // $\rho \sqrt{\sum |\Delta z|^2}$ over all copies
+		double rho;      // the final penalty weight
+		bool converged;
+	};
+
+	/**
+	 * fds are the sockets connected to the workers, rho is the initial
+	 * penalty weight. If adaptiveRho is set, rho is doubled or halved
+	 * whenever the primal and dual residuals differ by more than a factor 10.
+	 */
+	ConsensusCoordinator(const std::vector<int> &fds, double rho=1, bool adaptiveRho=true) :
+		fds(fds), rho(rho), adaptiveRho(adaptiveRho) {}
+
+	/**
+	 * Runs until the primal and dual residuals are below tolerance and the
+	 * relative change of the RSS is below tolerance, or maxIterations
+	 * is reached. Returns false on communication errors.
+	 */
+	bool run(int maxIterations, double tolerance, Stats &stats);
+
+	typedef int (*WorkerMain)(int index, int fd, void *arg);
+
+	/**
+	 * Forks numWorkers processes, each connected to this process by a
+	 * Unix-domain socket pair. Worker k calls workerMain(k, fd, arg) and
+	 * exits with its return value. Must be called before any threads
+	 * are started.
+	 */
+	static bool spawn(int numWorkers, WorkerMain workerMain, void *arg,
+			std::vector<int> &fds, std::vector<pid_t> &pids);
+
+	/**
+	 * Waits for the workers, returns true if all exited with 0.
+	 */
+	static bool join(const std::vector<pid_t> &pids);
+
+private:
+	std::vector<int> fds;
+	double rho;
+	bool adaptiveRho;
+
+	/**
+	 * The copies of a boundary variable, as (worker, offset) in the messages.
+	 */
+	struct Shared {
+		int dof;
+		std::vector<std::pair<int, int> > copies;
+	};
+};
+
+}  // namespace SLOM
+
+#endif /*CONSENSUS_H_*/
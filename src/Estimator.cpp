@@ -4,8 +4,17 @@
 #include <numeric>
 #include <cmath>
 #include <cassert>
+#include <vector>
+#include <set>
+#include <cstring>
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+#include <sys/time.h>
+#include <unistd.h>
 
 
 //#include "tools/cs_extension.h"
@@ -18,36 +27,100 @@ void Estimator::freeWorkspace(){
 	jacobian = cs_spfree(jacobian);
 	JtJ      = cs_spfree(JtJ);
 	symbolic = cs_sfree(symbolic);
-	numeric  = cs_nfree(numeric);
+	releaseFactor();
+	delete outOfCore;        outOfCore = 0;
+	delete submapSolver;     submapSolver = 0;
+	delete subgraphSolver;   subgraphSolver = 0;
 
 	delete[] res;            res = 0;
 	delete[] workspace;      workspace = 0;
+	delete[] perturbation;   perturbation = 0;
+	delete[] columnBuffer;   columnBuffer = 0;
 	delete[] cholCovariance; cholCovariance = 0;
+	std::vector<double>().swap(historyS);
+	std::vector<double>().swap(historyY);
+	std::vector<double>().swap(historyRho);
+	std::vector<double>().swap(gradient);
+	std::vector<double>().swap(previousGradient);
+	std::vector<double>().swap(direction);
+	historyCount = 0;
+	historyPending = false;
+	shape.clear();
 }
 
 
 Estimator::~Estimator(){
 	freeWorkspace();
+	delete pool;
 }
 
 
-double Estimator::evaluate(double * result) const{
-	IdxVector<IMeasurement>::const_iterator it = measurements.begin();
+void Estimator::setNumThreads(int n, bool pinThreads){
+	pool->resize(n-1, pinThreads);
+	// the buffers of the Jacobian and of LBFGS are per thread:
+	if(perturbation){
+		allocateThreadBuffers();
+	}
+}
+
+void Estimator::allocateThreadBuffers(){
+	int threads = pool->getNumThreads();
+	delete[] perturbation;
+	delete[] columnBuffer;
+	perturbation = new double[threads*maxDOF];
+	std::fill_n(perturbation, threads*maxDOF, 0);
+	columnBuffer = new double[threads*maxColumn];
+}
+
+
+/**
+ * Measurements are evaluated in chunks of EVAL_CHUNK measurements. 
+ * The sums of squares of the chunks are added in a fixed order,
+ * so the result does not depend on how chunks are assigned to threads.
+ */
+static const int EVAL_CHUNK = 256;
+
+/**
+ * Number of variables per task when calculating the Jacobian.
+ */
+static const int JACOBIAN_GRAIN = 16;
+
+double Estimator::evalChunk(double *result, int chunk) const{
+	IdxVector<IMeasurement>::const_iterator it = measurements.begin() + chunk*EVAL_CHUNK;
+	IdxVector<IMeasurement>::const_iterator end = 
+		measurements.end() - it > EVAL_CHUNK ? it + EVAL_CHUNK : measurements.end();
 	double sum = 0;
-	double *ptr = result;
-	for(; it != measurements.end(); it++){
-		assert(result + (*it)->idx == ptr);
+	for(; it != end; it++){
+		double *ptr = result + (*it)->idx;
 		(*it)->eval(ptr);
-		double *end = ptr+(*it)->getDim();
-		for( ; ptr < end; ptr++){
-			sum += std::pow(*ptr, 2);
+		for(double *last = ptr+(*it)->getDim(); ptr < last; ptr++){
+			sum += *ptr * *ptr;
 		}
 	}
 	return sum;
 }
 
+struct Estimator::EvalBody {
+	const Estimator *estimator;
+	double *result;
+	double *chunkSums;
+	void operator()(int chunk) const {
+		chunkSums[chunk] = estimator->evalChunk(result, chunk);
+	}
+};
+
+double Estimator::evaluate(double * result) const{
+	PhaseTimer timer(stepStats.time[StepStats::Evaluation]);
+	SLOM_STAT(stepStats.evaluations++);
+	int numChunks = (int(measurements.size()) + EVAL_CHUNK - 1) / EVAL_CHUNK;
+	std::vector<double> chunkSums(numChunks);
+	EvalBody body = {this, result, chunkSums.empty() ? 0 : &chunkSums[0]};
+	pool->parallelFor(numChunks, body);
+	return std::accumulate(chunkSums.begin(), chunkSums.end(), 0.0);
+}
+
 
-void Estimator::createSparse(){
+void Estimator::createSparse(css *ordering){
 	freeWorkspace();
 	int M = measurements.getDim();
 	int N = variables.getDim();
@@ -61,6 +134,10 @@ void Estimator::createSparse(){
 		size += N;
 		M += N;
 		skip = 1;
+		break;
+	case LBFGS:
+		assert(!"LBFGS uses createGradientWorkspace()");
+		break;
 	}
 	//allocate a compressed column matrix:
 	jacobian = cs_spalloc(M, N,   // size
@@ -73,23 +150,27 @@ void Estimator::createSparse(){
 	int *rIdx=jacobian->i; // row indices
 	*cIdx = 0; //first column starts at 0.
 	int n=measurements.getDim();
+	maxDOF = 0;
+	maxColumn = 0;
+	unconstrained = 0;
 	for(IdxVector<IRVWrapper>::const_iterator v = variables.begin(); v!= variables.end(); v++){
 		const IRVWrapper* var = *v;
 		int vDOF = var->getDOF();
 		assert(vDOF>0);
+		maxDOF = std::max(maxDOF, vDOF);
 		if(var->begin()==var->end()){
-			std::cerr << "No measurement for Variable " 
-			          << v - variables.begin() << std::endl;
-			assert(usedAlgorithm != GaussNewton);
-			// assert(var->begin() != var->end()); // No measurements
-
+			// reported by optimize(), optimizeStep() would fail for Gauss-Newton:
+			unconstrained++;
+			if(log) *log << "No measurement for Variable " << v - variables.begin() << std::endl;
 		}
 		for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
+			if(!ownMeasurement(*meas)) continue;
 			int row = (*meas)->idx;
 			for(int mDim = (*meas)->getDim(); mDim>0; mDim--){
 				*rIdx++ = row++;
 			}
 		}
+		maxColumn = std::max(maxColumn, int(rIdx - jacobian->i) - *cIdx);
 		if(usedAlgorithm != GaussNewton){
 			*rIdx++ = n++;
 		}
@@ -106,17 +187,214 @@ void Estimator::createSparse(){
 	//*cIdx = rIdx - matrix->i; //end of last column;
 	assert(*cIdx == size);
 
-	switch(usedSolver){
-	case QR:
-		symbolic = cs_sqr(3, jacobian, true);
-		assert(symbolic);
-		break;
-	case Cholesky:
-		break;
+	{
+		PhaseTimer timer(totalStats.time[StepStats::Symbolic]);
+		analyzeStructure();
+		switch(usedSolver){
+		case QR:
+			symbolic = ordering ? ordering : cs_sqr(3, jacobian, true);
+			assert(symbolic);
+			break;
+		case Cholesky:
+			createNormalEquations();
+			symbolic = ordering;
+			if(!symbolic){
+				symbolic = cs_schol(1, JtJ);
+				// a factor out of core is then read in windows of the elimination tree:
+				if(symbolic) OutOfCoreCholesky::postorder(symbolic, JtJ->n);
+			}
+			assert(symbolic);
+			break;
+		case Submaps:
+			createNormalEquations();
+			createSubmaps();
+			break;
+		case PCG:
+			createNormalEquations();
+			createSubgraph();
+			break;
+		}
 	}
 	res=new double[M];
 	lastRSS = -1;
+	fullStepTime = reuseStepTime = -1;
+	reuseSaving = 0;
 	workspace = new double[M];
+	allocateThreadBuffers();
+}
+
+
+bool Estimator::measurementBefore(const IMeasurement *m, int idx){
+	return m->idx < idx;
+}
+
+bool Estimator::ownMeasurement(const IMeasurement *meas) const{
+	IdxVector<IMeasurement>::const_iterator m = std::lower_bound(
+			measurements.begin(), measurements.end(), meas->idx, measurementBefore);
+	return m != measurements.end() && *m == meas;
+}
+
+/**
+ * Greedy coloring of items, such that items with a common neighbor get 
+ * different colors. neighbors[k] are the neighbors of item k, items[l] are
+ * the items which have l as neighbor. The items of each color are returned.
+ */
+static void colorGreedy(const std::vector<std::vector<int> > &neighbors,
+		const std::vector<std::vector<int> > &items,
+		std::vector<std::vector<int> > &colors)
+{
+	int numItems = neighbors.size();
+	std::vector<int> color(numItems, -1);
+	std::vector<int> usedBy; // usedBy[c] == k, if an item sharing a neighbor with k has color c
+	colors.clear();
+	for(int k=0; k<numItems; k++){
+		for(size_t l=0; l<neighbors[k].size(); l++){
+			const std::vector<int> &others = items[neighbors[k][l]];
+			for(size_t o=0; o<others.size(); o++){
+				if(color[others[o]] >= 0) usedBy[color[others[o]]] = k;
+			}
+		}
+		int c = 0;
+		while(c < (int)usedBy.size() && usedBy[c] == k) c++;
+		if(c == (int)usedBy.size()){
+			usedBy.push_back(-1);
+			colors.push_back(std::vector<int>());
+		}
+		color[k] = c;
+		colors[c].push_back(k);
+	}
+}
+
+void Estimator::analyzeStructure(){
+	int numVars = variables.size();
+	std::vector<std::vector<int> > measVars(measurements.size()), varMeas(numVars);
+	measurementStructure.assign(measurements.size(), MeasurementStructure());
+	foreignMeasurements = false;
+	for(int v=0; v<numVars; v++){
+		const IRVWrapper* var = variables[v];
+		int row = 0; // offset of the current measurement in the columns of var
+		for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
+			IdxVector<IMeasurement>::const_iterator m = std::lower_bound(
+					measurements.begin(), measurements.end(), (*meas)->idx, measurementBefore);
+			if(m == measurements.end() || *m != *meas){
+				// measurement belongs to another estimator, createSparse() gave it no rows
+				foreignMeasurements = true;
+				continue;
+			}
+			int k = m - measurements.begin();
+			int offset = row;
+			row += (*meas)->getDim();
+			if(!measVars[k].empty() && measVars[k].back() == v) continue; // registered twice
+			measVars[k].push_back(v);
+			varMeas[v].push_back(k);
+			measurementStructure[k].rows.push_back(offset);
+		}
+	}
+	colorGreedy(varMeas, measVars, variableColors);
+	colorGreedy(measVars, varMeas, measurementColors);
+	for(size_t k=0; k<measVars.size(); k++){
+		measurementStructure[k].vars.swap(measVars[k]);
+	}
+}
+
+
+/**
+ * Number of measurements per task when assembling JtJ.
+ */
+static const int ASSEMBLY_GRAIN = 64;
+
+void Estimator::createNormalEquations(){
+	int numVars = variables.size();
+	int n = variables.getDim();
+	// for each variable the variables of the JtJ blocks above and including 
+	// the diagonal, and the offsets of their rows in the columns of JtJ:
+	std::vector<std::vector<int> > blockVars(numVars), blockOffsets(numVars);
+	int size = 0;
+	for(size_t k=0; k<measurementStructure.size(); k++){
+		const std::vector<int> &vars = measurementStructure[k].vars;
+		for(size_t j=0; j<vars.size(); j++){
+			for(size_t i=0; i<=j; i++){
+				blockVars[vars[j]].push_back(vars[i]);
+			}
+		}
+	}
+	for(int v=0; v<numVars; v++){
+		std::vector<int> &bv = blockVars[v];
+		bv.push_back(v); // variables without measurement still need a diagonal
+		std::sort(bv.begin(), bv.end());
+		bv.erase(std::unique(bv.begin(), bv.end()), bv.end());
+		int above = 0;
+		for(size_t b=0; b<bv.size(); b++){
+			blockOffsets[v].push_back(above);
+			if(bv[b] != v) above += variables[bv[b]]->getDOF();
+		}
+		int vDOF = variables[v]->getDOF();
+		size += vDOF*above + vDOF*(vDOF+1)/2;
+	}
+	
+	JtJ = cs_spalloc(n, n, size, true, false);
+	int *cIdx = JtJ->p, *rIdx = JtJ->i;
+	*cIdx = 0;
+	for(int v=0; v<numVars; v++){
+		const std::vector<int> &bv = blockVars[v];
+		int vDOF = variables[v]->getDOF();
+		for(int t=0; t<vDOF; t++){
+			for(size_t b=0; b<bv.size(); b++){
+				const IRVWrapper *var = variables[bv[b]];
+				int rows = bv[b] == v ? t+1 : var->getDOF();
+				for(int r=0; r<rows; r++){
+					*rIdx++ = var->idx + r;
+				}
+			}
+			*++cIdx = rIdx - JtJ->i;
+		}
+	}
+	assert(*cIdx == size);
+	
+	for(size_t k=0; k<measurementStructure.size(); k++){
+		MeasurementStructure &ms = measurementStructure[k];
+		ms.blocks.resize(ms.vars.size()*(ms.vars.size()+1)/2);
+		for(size_t j=0; j<ms.vars.size(); j++){
+			const std::vector<int> &bv = blockVars[ms.vars[j]];
+			for(size_t i=0; i<=j; i++){
+				int b = std::lower_bound(bv.begin(), bv.end(), ms.vars[i]) - bv.begin();
+				ms.blocks[j*(j+1)/2+i] = blockOffsets[ms.vars[j]][b];
+			}
+		}
+	}
+}
+
+void Estimator::createSubmaps(){
+	int numVars = variables.size();
+	std::vector<std::vector<int> > adjacency(numVars);
+	for(size_t k=0; k<measurementStructure.size(); k++){
+		const std::vector<int> &vars = measurementStructure[k].vars;
+		for(size_t j=0; j<vars.size(); j++){
+			for(size_t i=0; i<j; i++){
+				adjacency[vars[i]].push_back(vars[j]);
+				adjacency[vars[j]].push_back(vars[i]);
+			}
+		}
+	}
+	std::vector<int> columns(numVars+1);
+	for(int v=0; v<numVars; v++){
+		std::vector<int> &adj = adjacency[v];
+		std::sort(adj.begin(), adj.end());
+		adj.erase(std::unique(adj.begin(), adj.end()), adj.end());
+		columns[v] = variables[v]->idx;
+	}
+	columns[numVars] = variables.getDim();
+	submapSolver = new SubmapSolver(JtJ, adjacency, columns, maxSubmapSize);
+}
+
+void Estimator::createSubgraph(){
+	int numVars = variables.size();
+	std::vector<int> columns(numVars+1);
+	for(int v=0; v<numVars; v++){
+		columns[v] = variables[v]->idx;
+	}
+	columns[numVars] = variables.getDim();
+	subgraphSolver = new SubgraphSolver(JtJ, columns, subgraphExtraEdges, pcgTolerance, pcgMaxIterations);
 }
 
 
@@ -128,78 +406,200 @@ void Estimator::initCovariance(){
 	std::fill_n(cholCovariance, n, 0);
 }
 
+struct Estimator::JacobianBody {
+	Estimator *estimator;
+	const std::vector<int> *vars;
+	void operator()(int k) const {
+		estimator->jacobianColumns((*vars)[k]);
+	}
+};
+
 void Estimator::calculateJacobian(){
 	assert(jacobian);   // matrix is allocated
 	assert(res);
 	assert(cholCovariance);
 	int m = jacobian->m, n = jacobian->n;
-	double *x = jacobian->x;
 
-	int skip=0;
 	switch(usedAlgorithm){
 	case GaussNewton:
 		assert(m == measurements.getDim());
 		assert(n == variables.getDim());
-		skip = 0;
 		break;
-	// For Levenberg(-Marquardt) put a diagonal matrix below the Jacobian:
+	// For Levenberg(-Marquardt) there is a diagonal matrix below the Jacobian,
+	// its entries are skipped by jacobianColumns:
 	case Levenberg:
 	case LevenbergMarquardt:
 		assert(m-n == measurements.getDim());
 		assert(n == variables.getDim());
-		skip = 1;
+		break;
+	case LBFGS:
+		assert(!"LBFGS has no Jacobian");
 		break;
 	}
+	(void)m; (void)n;
 
-	double *chol = cholCovariance;
+	PhaseTimer timer(stepStats.time[StepStats::Jacobian]);
+	for(size_t c=0; c<variableColors.size(); c++){
+		JacobianBody body = {this, &variableColors[c]};
+		pool->parallelFor(variableColors[c].size(), body, JACOBIAN_GRAIN);
+	}
+}
 
-	for(IdxVector<IRVWrapper>::iterator v = variables.begin(); v!= variables.end(); v++){
-		IRVWrapper* var = *v;
-		int vDOF = var->getDOF();
-		assert(vDOF>0);
-		double add[vDOF]; // temp-array for adding
-		std::fill_n(add, vDOF, 0);
-		for(int k=0; k<vDOF; k++){
-			double d = 1e6;
-			add[k] = (d ? 1/d : 0);
-
-			// store $f(\mu \mplus 1/d)$ in res:
-			var->add(add);
-			double *temp=workspace;
-			for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
-				temp=(*meas)->eval(temp);
-			}
-			var->restore();
+/**
+ * Calculates the columns of variable v of the Jacobian.
+ */
+void Estimator::jacobianColumns(int v){
+	int thread = pool->threadIndex();
+	double *add = perturbation + thread*maxDOF; // temp-array for adding, all zero
+	double *buffer = columnBuffer + thread*maxColumn;
 
-			// store $f(\mu \mplus -1/d)$ directly in the matrix:
-			var->add(add, -1);
-			temp = x;
-			for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
-				temp=(*meas)->eval(temp);
-			}
-			var->restore();
-
-			// calculate difference and multiply by $0.5d$
-			// also accumulate results for new inverse covariance
-			double c = 0;
-			for(double *xP=workspace ;x<temp; x++){
-				*x = 0.5*d*(*xP++ - *x);
-				assert(std::isfinite(*x));
-				c += std::pow(*x,2);
-			}
-			*chol++ = std::sqrt(c);
-			add[k] = 0; // reset delta-vector
-			x += skip; // skip one entry for Levenberg(-Marquardt)
+	IRVWrapper* var = variables[v];
+	int vDOF = var->getDOF();
+	assert(vDOF>0);
+	for(int k=0, col=var->idx; k<vDOF; k++, col++){
+		double d = 1e6;
+		add[k] = (d ? 1/d : 0);
+
+		// store $f(\mu \mplus 1/d)$ in buffer:
+		var->add(add);
+		double *temp=buffer;
+		for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
+			if(foreignMeasurements && !ownMeasurement(*meas)) continue;
+			temp=(*meas)->eval(temp);
+		}
+		var->restore();
+
+		// store $f(\mu \mplus -1/d)$ directly in the matrix:
+		var->add(add, -1);
+		double *x = jacobian->x + jacobian->p[col];
+		temp = x;
+		for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
+			if(foreignMeasurements && !ownMeasurement(*meas)) continue;
+			temp=(*meas)->eval(temp);
 		}
+		var->restore();
 
+		// calculate difference and multiply by $0.5d$
+		// also accumulate results for new inverse covariance
+		double c = 0;
+		for(double *xP=buffer ;x<temp; x++){
+			*x = 0.5*d*(*xP++ - *x);
+			assert(std::isfinite(*x));
+			c += *x * *x;
+		}
+		cholCovariance[col] = std::sqrt(c);
+		add[k] = 0; // reset delta-vector
 	}
+}
 
+void Estimator::createGradientWorkspace(){
+	freeWorkspace();
+	int M = measurements.getDim();
+	int N = variables.getDim();
+	maxDOF = 0;
+	maxColumn = 0;
+	for(IdxVector<IRVWrapper>::const_iterator v = variables.begin(); v!= variables.end(); v++){
+		const IRVWrapper* var = *v;
+		maxDOF = std::max(maxDOF, var->getDOF());
+		int rows = 0;
+		for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
+			if(ownMeasurement(*meas)) rows += (*meas)->getDim();
+		}
+		maxColumn = std::max(maxColumn, 2*rows); // room for $f(\mu \mplus 1/d)$ and $f(\mu \mplus -1/d)$
+	}
+	{
+		PhaseTimer timer(totalStats.time[StepStats::Symbolic]);
+		analyzeStructure();
+	}
+	gradient.assign(N, 0);
+	previousGradient.assign(N, 0);
+	direction.assign(N, 0);
+	historyS.assign(long(historySize)*N, 0);
+	historyY.assign(long(historySize)*N, 0);
+	historyRho.assign(historySize, 0);
+	historyCount = 0;
+	historyPending = false;
+	res = new double[M];
+	lastRSS = -1;
+	fullStepTime = reuseStepTime = -1;
+	reuseSaving = 0;
+	workspace = new double[M];
+	allocateThreadBuffers();
+}
 
+struct Estimator::GradientBody {
+	Estimator *estimator;
+	const std::vector<int> *vars;
+	void operator()(int k) const {
+		estimator->gradientEntries((*vars)[k]);
+	}
+};
 
+void Estimator::calculateGradient(){
+	assert(res && !gradient.empty());
+	PhaseTimer timer(stepStats.time[StepStats::Jacobian]);
+	for(size_t c=0; c<variableColors.size(); c++){
+		GradientBody body = {this, &variableColors[c]};
+		pool->parallelFor(variableColors[c].size(), body, JACOBIAN_GRAIN);
+	}
+}
+
+/**
+ * Calculates the entries of the gradient of variable v like the columns in
+ * jacobianColumns(), but multiplies them with res right away.
+ */
+void Estimator::gradientEntries(int v){
+	int thread = pool->threadIndex();
+	double *add = perturbation + thread*maxDOF; // temp-array for adding, all zero
+	double *plus = columnBuffer + thread*maxColumn;
+	double *minus = plus + maxColumn/2;
+
+	IRVWrapper* var = variables[v];
+	int vDOF = var->getDOF();
+	double *g = &gradient[var->idx];
+	if(!var->optimize){
+		std::fill_n(g, vDOF, 0);
+		return;
+	}
+	for(int k=0; k<vDOF; k++){
+		double d = 1e6;
+		add[k] = 1/d;
+
+		var->add(add);
+		double *temp = plus;
+		for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
+			if(foreignMeasurements && !ownMeasurement(*meas)) continue;
+			temp=(*meas)->eval(temp);
+		}
+		var->restore();
+
+		var->add(add, -1);
+		temp = minus;
+		for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
+			if(foreignMeasurements && !ownMeasurement(*meas)) continue;
+			temp=(*meas)->eval(temp);
+		}
+		var->restore();
+
+		// central difference of the column times the residuum:
+		double sum = 0;
+		const double *p = plus, *q = minus;
+		for(IRVWrapper::const_iterator meas= var->begin(); meas!= var->end(); meas++){
+			if(foreignMeasurements && !ownMeasurement(*meas)) continue;
+			const double *r = res + (*meas)->idx;
+			for(int dim = (*meas)->getDim(); dim>0; dim--){
+				sum += (*p++ - *q++) * *r++;
+			}
+		}
+		g[k] = 0.5*d*sum;
+		assert(std::isfinite(g[k]));
+		add[k] = 0; // reset delta-vector
+	}
 }
 
 void Estimator::updateDiagonal() {
 	if(usedAlgorithm == GaussNewton) return;
+	PhaseTimer timer(stepStats.time[StepStats::Damping]);
 	// for LMA set the last entry of each column to lamda or lamda*cholCovariance;
 	int n=jacobian->n;
 	int *p = jacobian->p;
@@ -219,10 +619,22 @@ void Estimator::updateSparse(){
 
 void Estimator::qrSolve(double* delta){
 	assert(symbolic);
-	cs_nfree(numeric);
-	numeric = cs_qr(jacobian, symbolic);
-	assert(numeric);
+	{
+		PhaseTimer timer(stepStats.time[StepStats::Factorization]);
+		cs_nfree(numeric);
+		numeric = cs_qr(jacobian, symbolic);
+		assert(numeric);
+	}
+	SLOM_STAT(stepStats.nnzL = numeric->U->p[jacobian->n]);
+	qrBackSolve(delta);
+}
+
+/**
+ * Solves for res with the current QR factorization.
+ */
+void Estimator::qrBackSolve(double* delta){
 	int m=jacobian->m, n=jacobian->n;
+	PhaseTimer timer(stepStats.time[StepStats::Solve]);
 
 	// The following code essentially does a cs_qrsol(3, matrix, workspace);
 	// but it doesn't recalculate the symbolic decomposition
@@ -238,28 +650,639 @@ void Estimator::qrSolve(double* delta){
 	// end of qrsol
 }
 
+struct Estimator::AssemblyBody {
+	Estimator *estimator;
+	const std::vector<int> *meas;
+	double *rhs;
+	void operator()(int k) const {
+		estimator->assembleMeasurement((*meas)[k], rhs);
+	}
+};
+
+void Estimator::assembleNormalEquations(double *rhs, bool addDamping){
+	assert(JtJ);
+	PhaseTimer timer(stepStats.time[StepStats::Assembly]);
+	int n = jacobian->n;
+	std::fill_n(JtJ->x, JtJ->p[n], 0);
+	std::fill_n(rhs, n, 0);
+	for(size_t c=0; c<measurementColors.size(); c++){
+		AssemblyBody body = {this, &measurementColors[c], rhs};
+		pool->parallelFor(measurementColors[c].size(), body, ASSEMBLY_GRAIN);
+	}
+	if(usedAlgorithm != GaussNewton && addDamping){
+		// add the diagonal matrix below the Jacobian:
+		for(int k=0; k<n; k++){
+			double d = jacobian->x[jacobian->p[k+1]-1];
+			JtJ->x[JtJ->p[k+1]-1] += d*d;
+		}
+	}
+}
+
+/**
+ * Adds the contribution of measurement k to JtJ and rhs.
+ * Only the columns and rows of its own variables are written.
+ */
+void Estimator::assembleMeasurement(int k, double *rhs){
+	const MeasurementStructure &ms = measurementStructure[k];
+	const IMeasurement *meas = measurements[k];
+	int dim = meas->getDim();
+	const double *r = res + meas->idx;
+	const int *Jp = jacobian->p;
+	const double *Jx = jacobian->x;
+	for(size_t j=0; j<ms.vars.size(); j++){
+		const IRVWrapper *varJ = variables[ms.vars[j]];
+		for(int t=0, col=varJ->idx; t<varJ->getDOF(); t++, col++){
+			const double *Jb = Jx + Jp[col] + ms.rows[j];
+			rhs[col] += std::inner_product(Jb, Jb+dim, r, 0.0);
+			double *out = JtJ->x + JtJ->p[col];
+			for(size_t i=0; i<=j; i++){
+				const IRVWrapper *varI = variables[ms.vars[i]];
+				double *o = out + ms.blocks[j*(j+1)/2+i];
+				int rows = i<j ? varI->getDOF() : t+1;
+				for(int s=0; s<rows; s++){
+					const double *Ja = Jx + Jp[varI->idx+s] + ms.rows[i];
+					o[s] += std::inner_product(Ja, Ja+dim, Jb, 0.0);
+				}
+			}
+		}
+	}
+}
+
+void Estimator::releaseFactor(){
+	if(outOfCore && outOfCore->owns(numeric)){
+		numeric = 0;
+	} else {
+		numeric = cs_nfree(numeric);
+	}
+}
+
+csn* Estimator::choleskyFactorize(){
+	double factorBytes = symbolic->lnz * (sizeof(int) + sizeof(double));
+	if(outOfCoreDirectory.empty() || factorBytes <= inCoreBudget){
+		return cs_chol(JtJ, symbolic);
+	}
+	if(!outOfCore) outOfCore = new OutOfCoreCholesky(outOfCoreDirectory);
+	csn *N = outOfCore->factorize(JtJ, symbolic, inCoreBudget);
+	if(N) return N;
+	// no room for the scratch file, or JtJ is not positive definite:
+	if(log) *log << ", factorizing out of core failed, factorizing in memory";
+	return cs_chol(JtJ, symbolic);
+}
+
 void Estimator::choleskySolve(double *delta){
-	// TODO reduce number of copies and mallocs.
-	// TODO reuse symbolic Cholesky decomp.
-	// TODO reuse structure of JtJ, only store upper half
-	cs* Jt = cs_transpose(jacobian, true);
-	cs_spfree(JtJ);
-	JtJ = cs_multiply(Jt, jacobian);
-	assert(Jt && JtJ);
-	std::fill(workspace, workspace+jacobian->m, 0);
-	cs_gaxpy(Jt, res, workspace);
-	Jt = cs_spfree(Jt);
-	int ok=cs_cholsol(1, JtJ, workspace);
+	assert(symbolic);
+	assembleNormalEquations(workspace);
+	{
+		PhaseTimer timer(stepStats.time[StepStats::Factorization]);
+		releaseFactor();
+		numeric = choleskyFactorize();
+		assert(numeric);
+	}
+	SLOM_STAT(stepStats.nnzL = numeric->L->p[jacobian->n]);
+	choleskyBackSolve(delta);
+}
+
+/**
+ * Solves for the right hand side in workspace with the current Cholesky 
+ * factorization.
+ */
+void Estimator::choleskyBackSolve(double *delta){
+	int n=jacobian->n;
+	PhaseTimer timer(stepStats.time[StepStats::Solve]);
+
+	// The following code essentially does a cs_cholsol(1, JtJ, workspace);
+	// but it doesn't recalculate the symbolic decomposition.
+	// delta is used as temporary, as res is not needed anymore.
+	cs_ipvec(symbolic->pinv, workspace, delta, n); /* x = P*b */
+	cs_lsolve(numeric->L, delta);                  /* x = L\x */
+	cs_ltsolve(numeric->L, delta);                 /* x = L'\x */
+	cs_pvec(symbolic->pinv, delta, workspace, n);  /* b = P'*x */
+	std::copy(workspace, workspace + n, delta);
+}
+
+void Estimator::submapSolve(double *delta){
+	assert(submapSolver);
+	assembleNormalEquations(workspace);
+	{
+		PhaseTimer timer(stepStats.time[StepStats::Factorization]);
+		bool ok = submapSolver->solve(JtJ, workspace, *pool);
+		assert(ok); (void) ok;
+	}
+	SLOM_STAT(stepStats.nnzL = submapSolver->getFactorNonZeros());
 	std::copy(workspace, workspace + jacobian->n, delta);
-	JtJ = cs_spfree(JtJ);
-	assert(ok && !Jt && !JtJ);
 }
 
+/**
+ * Solves with the PCG solver, delta holds the Newton step afterwards.
+ * Returns false if JtJ is not positive definite.
+ */
+bool Estimator::pcgSolve(double *delta){
+	assert(subgraphSolver);
+	assembleNormalEquations(workspace);
+	std::copy(workspace, workspace + jacobian->n, delta);
+	PhaseTimer timer(stepStats.time[StepStats::Factorization]);
+	return pcgSolveSystem(JtJ, delta, workspace, true);
+}
 
-void Estimator::initialize(){
+/**
+ * Solves A x = b with the PCG solver, b is overwritten by x. If CG does not
+ * reach the tolerance, A is factorized directly instead. work needs n
+ * entries, stats selects whether nnzL is recorded.
+ * Returns false if A is not positive definite.
+ */
+bool Estimator::pcgSolveSystem(const cs *A, double *b, double *work, bool stats){
+	int n = A->n;
+	std::copy(b, b + n, work); // keep the right hand side
+	bool ok = subgraphSolver->solve(A, b);
+	if(stats){
+		SLOM_STAT(stepStats.nnzL = subgraphSolver->getFactorNonZeros());
+	}
+	if(ok) return true;
+	// CG did not converge, solve directly like cs_cholsol(1, A, work):
+	if(log) *log << ", CG stopped at residual " << subgraphSolver->getResidual() 
+			<< " after " << subgraphSolver->getIterations() << " iterations, solving directly";
+	css *S = cs_schol(1, A);
+	csn *N = S ? cs_chol(A, S) : 0;
+	ok = N != 0;
+	if(ok){
+		if(stats){
+			SLOM_STAT(stepStats.nnzL = N->L->p[n]);
+		}
+		cs_ipvec(S->pinv, work, b, n);
+		cs_lsolve(N->L, b);
+		cs_ltsolve(N->L, b);
+		cs_pvec(S->pinv, b, work, n);
+		std::copy(work, work + n, b);
+	}
+	cs_nfree(N);
+	cs_sfree(S);
+	return ok;
+}
+
+
+void Estimator::computeShape(std::vector<int> &shape) const{
+	shape.clear();
+	shape.push_back(usedAlgorithm);
+	shape.push_back(usedSolver);
+	shape.push_back(variables.size());
+	for(IdxVector<IRVWrapper>::const_iterator v = variables.begin(); v!= variables.end(); v++){
+		shape.push_back((*v)->getDOF());
+	}
+	shape.push_back(measurements.size());
+	for(IdxVector<IMeasurement>::const_iterator m = measurements.begin(); m!= measurements.end(); m++){
+		shape.push_back((*m)->getDim());
+	}
+	// the rows of each variable's columns:
+	for(IdxVector<IRVWrapper>::const_iterator v = variables.begin(); v!= variables.end(); v++){
+		for(IRVWrapper::const_iterator meas= (*v)->begin(); meas!= (*v)->end(); meas++){
+			shape.push_back((*meas)->idx);
+		}
+		shape.push_back(-1);
+	}
+}
+
+bool Estimator::initialize(){
+	SLOM_STAT(stepStats.clear());
+	SLOM_STAT(totalStats.clear());
+	std::vector<int> newShape;
+	computeShape(newShape);
+	if(res && newShape == shape){
+		// same structure as before, only reset the state of the optimization:
+		lastRSS = -1;
+		historyCount = 0;
+		historyPending = false;
+		releaseFactor(); // belongs to the previous problem
+		fullStepTime = reuseStepTime = -1;
+		reuseSaving = 0;
+		std::fill_n(cholCovariance, variables.getDim(), 0);
+		return true;
+	}
 	freeWorkspace();
-	createSparse();
+	bool cached = !orderingCache.empty() && hasOrdering();
+	css *ordering = 0;
+	if(cached){
+		PhaseTimer timer(totalStats.time[StepStats::Symbolic]);
+		ordering = loadOrdering(newShape);
+	}
+	if(usedAlgorithm == LBFGS){
+		createGradientWorkspace();
+	} else {
+		createSparse(ordering);
+	}
+	if(cached && !ordering){
+		saveOrdering(newShape);
+	}
 	initCovariance();
+	shape.swap(newShape);
+	return false;
+}
+
+/*
+ * Checkpoints, all values in host byte order:
+ * magic, version, shape (see computeShape()), coordinates of all variables,
+ * lamda, lastRSS, fullStepTime, reuseStepTime, reuseSaving,
+ * flag and symbolic decomposition: pinv, q, parent, cp, leftmost, m2, lnz, unz,
+ * flag and numeric decomposition: Jacobian values, cholCovariance, L, U, B.
+ * Arrays are written with their length, -1 for a missing array.
+ */
+static const char CHECKPOINT_MAGIC[8] = {'S', 'L', 'o', 'M', 'C', 'K', 'P', 'T'};
+static const int CHECKPOINT_VERSION = 2;
+
+template<typename T>
+static void writeValue(std::ostream &out, const T &v){
+	out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template<typename T>
+static bool readValue(std::istream &in, T &v){
+	return !in.read(reinterpret_cast<char*>(&v), sizeof(T)).fail();
+}
+
+template<typename T>
+static void writeArray(std::ostream &out, const T *a, int len){
+	if(!a) len = -1;
+	writeValue(out, len);
+	if(len > 0) out.write(reinterpret_cast<const char*>(a), len*sizeof(T));
+}
+
+/**
+ * Reads an array of the expected length into memory allocated by cs_malloc,
+ * returns 0 for a missing array. Clears ok on errors.
+ */
+template<typename T>
+static T* readArray(std::istream &in, int expected, bool &ok){
+	int len;
+	if(!ok || !readValue(in, len) || (len != expected && len != -1)){
+		ok = false;
+		return 0;
+	}
+	if(len < 0) return 0;
+	T *a = static_cast<T*>(cs_malloc(len, sizeof(T)));
+	if(in.read(reinterpret_cast<char*>(a), len*sizeof(T)).fail()) ok = false;
+	return a;
+}
+
+/*
+ * Checkpoints and cached orderings are read from files, so every index
+ * is checked before CSparse uses it.
+ */
+
+/**
+ * All len values of a are in [lo, hi).
+ */
+static bool inRange(const int *a, int len, int lo, int hi){
+	for(int k=0; k<len; k++){
+		if(a[k] < lo || a[k] >= hi) return false;
+	}
+	return true;
+}
+
+/**
+ * The first len values of a are distinct and in [0, n).
+ */
+static bool isInjective(const int *a, int len, int n){
+	if(!inRange(a, len, 0, n)) return false;
+	std::vector<char> seen(n, false);
+	for(int k=0; k<len; k++){
+		if(seen[a[k]]) return false;
+		seen[a[k]] = true;
+	}
+	return true;
+}
+
+/**
+ * p are the n+1 column pointers of a matrix with nz entries.
+ */
+static bool isColumnPointer(const int *p, int n, int nz){
+	if(p[0] != 0 || p[n] != nz) return false;
+	for(int k=0; k<n; k++){
+		if(p[k] > p[k+1]) return false;
+	}
+	return true;
+}
+
+static void writeMatrix(std::ostream &out, const cs *A){
+	writeValue(out, char(A != 0));
+	if(!A) return;
+	writeValue(out, A->m);
+	writeValue(out, A->n);
+	writeArray(out, A->p, A->n+1);
+	writeArray(out, A->i, A->p[A->n]);
+	writeArray(out, A->x, A->p[A->n]);
+}
+
+/**
+ * Reads an m x n matrix with nz entries written by writeMatrix(), returns 0
+ * if none was written. Clears ok on errors and if the matrix has another
+ * size or invalid indices.
+ */
+static cs* readMatrix(std::istream &in, int m, int n, int nz, bool &ok){
+	char present = 0;
+	int rows = 0, cols = 0;
+	if(!ok || !readValue(in, present) || !present) return 0;
+	if(!readValue(in, rows) || !readValue(in, cols) || rows != m || cols != n){
+		ok = false;
+		return 0;
+	}
+	int *p = readArray<int>(in, n+1, ok);
+	if(!ok || !p || !isColumnPointer(p, n, nz)){
+		cs_free(p);
+		ok = false;
+		return 0;
+	}
+	cs *A = cs_spalloc(m, n, nz, true, false);
+	std::copy(p, p+n+1, A->p);
+	cs_free(p);
+	int *i = readArray<int>(in, nz, ok);
+	double *x = readArray<double>(in, nz, ok);
+	if(ok && i && x && inRange(i, nz, 0, m)){
+		std::copy(i, i+nz, A->i);
+		std::copy(x, x+nz, A->x);
+	} else {
+		ok = false;
+	}
+	cs_free(i);
+	cs_free(x);
+	return A;
+}
+
+static void writeSymbolic(std::ostream &out, const css *S, const int sizes[5]){
+	writeValue(out, char(S != 0));
+	if(!S) return;
+	writeArray(out, S->pinv, sizes[0]);
+	writeArray(out, S->q, sizes[1]);
+	writeArray(out, S->parent, sizes[2]);
+	writeArray(out, S->cp, sizes[3]);
+	writeArray(out, S->leftmost, sizes[4]);
+	writeValue(out, S->m2);
+	writeValue(out, S->lnz);
+	writeValue(out, S->unz);
+}
+
+/**
+ * Checks the symbolic decomposition S with the sizes of symbolicSizes(),
+ * as cs_sqr() (qr) or cs_schol() computes it.
+ */
+static bool validSymbolic(const css *S, const int sizes[5], bool qr){
+	int n = sizes[1], m = sizes[4];
+	if(S->lnz < 0 || S->unz < 0) return false;
+	if(S->q && !isInjective(S->q, n, n)) return false;
+	if(S->parent && !inRange(S->parent, n, -1, n)) return false;
+	if(S->leftmost && !inRange(S->leftmost, m, -1, n)) return false;
+	if(qr){
+		// the rows of A map into the m2 rows of V, cp holds the column counts of R:
+		if(S->m2 < m || S->m2 > m+n) return false;
+		if(S->pinv && !isInjective(S->pinv, m, S->m2)) return false;
+		if(S->cp){
+			if(!inRange(S->cp, n, 0, n+1)) return false;
+			long sum = 0;
+			for(int k=0; k<n; k++) sum += S->cp[k];
+			if(sum != S->unz) return false;
+		}
+	} else {
+		if(S->pinv && !isInjective(S->pinv, n, n)) return false;
+		if(S->cp && !isColumnPointer(S->cp, n, S->lnz)) return false;
+	}
+	return true;
+}
+
+/**
+ * Reads a symbolic decomposition written by writeSymbolic(), returns 0 if
+ * none was written. Clears ok on errors and if it fails validSymbolic().
+ */
+static css* readSymbolic(std::istream &in, const int sizes[5], bool qr, bool &ok){
+	char present = 0;
+	if(!ok || !readValue(in, present)){
+		ok = false;
+		return 0;
+	}
+	if(!present) return 0;
+	css *S = static_cast<css*>(cs_calloc(1, sizeof(css)));
+	S->pinv     = readArray<int>(in, sizes[0], ok);
+	S->q        = readArray<int>(in, sizes[1], ok);
+	S->parent   = readArray<int>(in, sizes[2], ok);
+	S->cp       = readArray<int>(in, sizes[3], ok);
+	S->leftmost = readArray<int>(in, sizes[4], ok);
+	ok = ok && readValue(in, S->m2) && readValue(in, S->lnz) && readValue(in, S->unz)
+			&& validSymbolic(S, sizes, qr);
+	return S;
+}
+
+/**
+ * Lengths of pinv, q, parent, cp and leftmost of the symbolic decomposition,
+ * as allocated by cs_sqr() and cs_schol().
+ */
+void Estimator::symbolicSizes(int sizes[5]) const{
+	int n = variables.getDim();
+	int m = measurements.getDim() + (usedAlgorithm == GaussNewton ? 0 : n);
+	if(usedSolver == QR){
+		int qr[5] = {m+n, n, n, n, m};
+		std::copy(qr, qr+5, sizes);
+	} else {
+		int chol[5] = {n, n, n, n+1, m};
+		std::copy(chol, chol+5, sizes);
+	}
+}
+
+bool Estimator::saveCheckpoint(std::ostream &out, bool withFactor) const{
+	assert(res);
+	out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	writeValue(out, CHECKPOINT_VERSION);
+	writeArray(out, &shape[0], shape.size());
+	std::vector<double> coords(variables.getDim());
+	for(IdxVector<IRVWrapper>::const_iterator v = variables.begin(); v!= variables.end(); v++){
+		(*v)->save(&coords[(*v)->idx]);
+	}
+	writeArray(out, &coords[0], coords.size());
+	writeValue(out, lamda);
+	writeValue(out, lastRSS);
+	writeValue(out, fullStepTime);
+	writeValue(out, reuseStepTime);
+	writeValue(out, reuseSaving);
+	
+	int sizes[5];
+	symbolicSizes(sizes);
+	writeSymbolic(out, symbolic, sizes);
+	
+	int n = variables.getDim();
+	bool factor = withFactor && numeric;
+	writeValue(out, char(factor));
+	if(factor){
+		writeArray(out, jacobian->x, jacobian->p[n]);
+		writeArray(out, cholCovariance, n);
+		writeMatrix(out, numeric->L);
+		writeMatrix(out, numeric->U);
+		writeArray(out, numeric->B, n);
+	}
+	return out.good();
+}
+
+bool Estimator::loadCheckpoint(std::istream &in){
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	int version;
+	if(in.read(magic, sizeof(magic)).fail() || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0
+			|| !readValue(in, version) || version != CHECKPOINT_VERSION){
+		return false;
+	}
+	// the structure has to be the same:
+	std::vector<int> newShape;
+	computeShape(newShape);
+	bool ok = true;
+	int *savedShape = readArray<int>(in, newShape.size(), ok);
+	ok = ok && savedShape && std::equal(newShape.begin(), newShape.end(), savedShape);
+	cs_free(savedShape);
+	
+	// read everything before changing anything:
+	double *coords = readArray<double>(in, variables.getDim(), ok);
+	ok = ok && coords;
+	for(int k=0; ok && k<variables.getDim(); k++) ok = std::isfinite(coords[k]);
+	double newLamda = 0, savedRSS = 0, times[3];
+	ok = ok && readValue(in, newLamda) && readValue(in, savedRSS) 
+			&& readValue(in, times[0]) && readValue(in, times[1]) && readValue(in, times[2])
+			&& std::isfinite(newLamda) && newLamda >= 0;
+	
+	int sizes[5];
+	symbolicSizes(sizes);
+	css *ordering = readSymbolic(in, sizes, usedSolver == QR, ok);
+	ok = ok && (!hasOrdering() || ordering);
+	
+	int n = variables.getDim();
+	int values_J = nnz + (usedAlgorithm == GaussNewton ? 0 : n);
+	double *jacobianValues = 0, *covariance = 0;
+	csn *factor = 0;
+	char flag = 0;
+	ok = ok && readValue(in, flag);
+	// a factor is only valid with its ordering:
+	ok = ok && (!flag || ordering);
+	if(ok && flag){
+		jacobianValues = readArray<double>(in, values_J, ok);
+		covariance = readArray<double>(in, n, ok);
+		factor = static_cast<csn*>(cs_calloc(1, sizeof(csn)));
+		// the factor has to match the ordering: V and R of cs_qr() or L of cs_chol()
+		int rows = usedSolver == QR ? ordering->m2 : n;
+		factor->L = readMatrix(in, rows, n, ordering->lnz, ok);
+		factor->U = readMatrix(in, rows, n, ordering->unz, ok);
+		factor->B = readArray<double>(in, n, ok);
+		ok = ok && jacobianValues && covariance && factor->L;
+	}
+	ok = ok && !in.fail();
+	
+	if(!ok){
+		cs_sfree(ordering);
+		cs_nfree(factor);
+		cs_free(jacobianValues);
+		cs_free(covariance);
+		cs_free(coords);
+		return false;
+	}
+	
+	for(IdxVector<IRVWrapper>::iterator v = variables.begin(); v!= variables.end(); v++){
+		(*v)->load(coords + (*v)->idx);
+	}
+	cs_free(coords);
+	lamda = newLamda;
+	SLOM_STAT(stepStats.clear());
+	SLOM_STAT(totalStats.clear());
+	if(usedAlgorithm == LBFGS){
+		createGradientWorkspace();
+	} else {
+		createSparse(ordering);
+	}
+	initCovariance();
+	shape.swap(newShape);
+	// res is not stored, the RSS has to be evaluated again:
+	lastRSS = -std::abs(savedRSS);
+	// for optimizeWithin(), assuming the same machine:
+	fullStepTime = times[0];
+	reuseStepTime = times[1];
+	reuseSaving = times[2];
+	if(factor){
+		std::copy(jacobianValues, jacobianValues + values_J, jacobian->x);
+		std::copy(covariance, covariance + n, cholCovariance);
+		numeric = factor;
+		cs_free(jacobianValues);
+		cs_free(covariance);
+	}
+	return true;
+}
+
+/*
+ * Cached orderings: magic, version, shape, symbolic decomposition like in
+ * checkpoints. The file name is a hash of the shape, the shape itself is
+ * compared on loading, so colliding or outdated files are only ignored.
+ */
+static const char ORDERING_MAGIC[8] = {'S', 'L', 'o', 'M', 'O', 'R', 'D', 'R'};
+static const int ORDERING_VERSION = 2;
+
+std::string Estimator::orderingFile(const std::vector<int> &shape) const{
+	// 64 bit FNV-1a of the shape:
+	unsigned long long hash = 14695981039346656037ULL;
+	for(size_t k=0; k<shape.size(); k++){
+		unsigned int v = shape[k];
+		for(int b=0; b<4; b++, v >>= 8){
+			hash = (hash ^ (v & 0xff)) * 1099511628211ULL;
+		}
+	}
+	std::ostringstream name;
+	name << orderingCache << "/slom-" << std::hex << hash << ".ordering";
+	return name.str();
+}
+
+css* Estimator::loadOrdering(const std::vector<int> &shape) const{
+	std::ifstream in(orderingFile(shape).c_str(), std::ios::binary);
+	if(!in) return 0;
+	char magic[sizeof(ORDERING_MAGIC)];
+	int version;
+	if(in.read(magic, sizeof(magic)).fail() || std::memcmp(magic, ORDERING_MAGIC, sizeof(magic)) != 0
+			|| !readValue(in, version) || version != ORDERING_VERSION){
+		return 0;
+	}
+	bool ok = true;
+	int *savedShape = readArray<int>(in, shape.size(), ok);
+	ok = ok && savedShape && std::equal(shape.begin(), shape.end(), savedShape);
+	cs_free(savedShape);
+	int sizes[5];
+	symbolicSizes(sizes);
+	css *ordering = readSymbolic(in, sizes, usedSolver == QR, ok);
+	if(!ok || !ordering){
+		cs_sfree(ordering);
+		return 0;
+	}
+	return ordering;
+}
+
+void Estimator::saveOrdering(const std::vector<int> &shape) const{
+	if(!symbolic) return;
+	std::string file = orderingFile(shape);
+	// write to a temporary file first, so concurrent runs never read a partial file:
+	std::ostringstream tmp;
+	tmp << file << "." << getpid();
+	{
+		std::ofstream out(tmp.str().c_str(), std::ios::binary);
+		if(!out) return;
+		out.write(ORDERING_MAGIC, sizeof(ORDERING_MAGIC));
+		writeValue(out, ORDERING_VERSION);
+		writeArray(out, &shape[0], shape.size());
+		int sizes[5];
+		symbolicSizes(sizes);
+		writeSymbolic(out, symbolic, sizes);
+		out.close();
+		if(out.fail()){
+			std::remove(tmp.str().c_str());
+			return;
+		}
+	}
+	if(std::rename(tmp.str().c_str(), file.c_str()) != 0){
+		std::remove(tmp.str().c_str());
+	}
+}
+
+void Estimator::clear(){
+	variables.clear();
+	measurements.clear();
+	nnz = 0;
+	measurementVariables.clear();
+	registrationsSeen.clear();
 }
 
 static inline bool absCmp(double a, double b){
@@ -267,9 +1290,64 @@ static inline bool absCmp(double a, double b){
 }
 
 
+/**
+ * Maximal number of times a Gauss-Newton step is halved by optimizeWithin().
+ */
+static const int MAX_HALVINGS = 8;
+
+void Estimator::addDelta(const double *delta, double scale){
+	for(IdxVector<IRVWrapper>::iterator v = variables.begin(); v!= variables.end(); v++){
+		IRVWrapper* var = *v;
+		if(var->optimize){
+			delta = var->add(delta, -scale);
+		} else {
+			delta += var->getDOF();
+		}
+	}
+}
+
+void Estimator::storeVariables(const double *delta, double scale){
+	for(IdxVector<IRVWrapper>::iterator v = variables.begin(); v!= variables.end(); v++){
+		IRVWrapper* var = *v;
+		var->store();
+		int vDOF = var->getDOF();
+		if(var->optimize){
+			var->change = scale * std::abs(*std::max_element(delta, delta+vDOF, absCmp));
+		}
+		delta += vDOF;
+	}
+}
+
+/**
+ * Infinity norm of $J^T r$, the rows of the damping term are ignored.
+ */
+double Estimator::gradientNorm() const{
+	int n = jacobian->n, rows = measurements.getDim();
+	double norm = 0;
+	for(int c=0; c<n; c++){
+		double g = 0;
+		for(int k=jacobian->p[c]; k<jacobian->p[c+1]; k++){
+			if(jacobian->i[k] < rows) g += jacobian->x[k] * res[jacobian->i[k]];
+		}
+		norm = std::max(norm, std::abs(g));
+	}
+	return norm;
+}
+
 double Estimator::optimizeStep(){
 	// TODO better parameter control for LMA
+	if(usedAlgorithm == LBFGS){
+		double gain = lbfgsStep();
+		finishStep();
+		return gain;
+	}
 	assert(jacobian);
+	SLOM_STAT(stepStats.clear());
+	if(numDampings > 1 && usedAlgorithm != GaussNewton){
+		double gain = speculativeStep();
+		finishStep();
+		return gain;
+	}
 
 	int m=jacobian->m, n=jacobian->n;
 
@@ -280,10 +1358,11 @@ double Estimator::optimizeStep(){
 	if(lastRSS < 0){
 		lastRSS = evaluate(res);
 	}
-	std::cout << lastRSS;
+	if(log) *log << lastRSS;
 	if(usedAlgorithm != GaussNewton){
 		std::fill(res + m-n, res+m, 0);
 	}
+	lastGradient = gradientNorm();
 
 	double* delta = usedAlgorithm == GaussNewton ? res : res + m-n;
 
@@ -295,34 +1374,63 @@ double Estimator::optimizeStep(){
 	case Cholesky:
 		choleskySolve(delta);
 		break;
+	case Submaps:
+		submapSolve(delta);
+		break;
+	case PCG:
+		if(!pcgSolve(delta)){
+			// no step, increase lamda as for a rejected one:
+			if(log) *log << ", not positive definite" << std::endl;
+			lamda *= sqrt(10.0);
+			lastRSS = -lastRSS; // res got overwritten
+			finishStep();
+			return -1;
+		}
+		break;
 	}
 
+	double gain = takeStep(delta);
+	finishStep();
+	return gain;
+}
+
+/**
+ * Adds delta to the variables and keeps the result if it is better or if
+ * Gauss-Newton is used and steps have not to be monotone. Adapts lamda.
+ */
+double Estimator::takeStep(const double *delta){
+	int m=jacobian->m, n=jacobian->n;
 	const double *temp=delta;
 	//some information about the delta_vector:
 	double normInf=0, norm2=0;
 	norm2 = std::inner_product(temp, temp+n, temp, norm2);
 	normInf = std::abs(*std::max_element(temp, temp+n, absCmp));
-	std::cout << ", Update: rms: " << std::sqrt(norm2/n) << " normInf: " << normInf; 
+	if(log) *log << ", Update: rms: " << std::sqrt(norm2/n) << " normInf: " << normInf; 
 	
 	// Add delta-vector to the variables:
-	for(IdxVector<IRVWrapper>::iterator v = variables.begin(); v!= variables.end(); v++){
-		IRVWrapper* var = *v;
-		if(var->optimize){
-			temp = var->add(temp, -1);
-		} else {
-			temp += var->getDOF();
-		}
-	}
+	addDelta(delta);
 	// calculate the new RSS:
 	double newRSS = evaluate(workspace);
 	double gain = (lastRSS - newRSS)/newRSS;
-	std::cout << ", RSS: " << newRSS << ", RMS: " << std::sqrt(newRSS/m) << ", Gain: " << gain;
-	if(gain > 0 || usedAlgorithm == GaussNewton){
-		// positive gain or GaussNewton: 
-		// Store modified variables permanently, current RSS to res, and reduce lamda.
+	double scale = 1;
+	// monotone Gauss-Newton: halve the step until the RSS decreases
+	for(int h=0; h<MAX_HALVINGS && gain <= 0 && usedAlgorithm == GaussNewton && monotone; h++){
 		for(IdxVector<IRVWrapper>::iterator v = variables.begin(); v!= variables.end(); v++){
-			(*v)->store();
+			(*v)->restore();
 		}
+		normInf *= 0.5;
+		scale *= 0.5;
+		addDelta(delta, scale);
+		newRSS = evaluate(workspace);
+		gain = (lastRSS - newRSS)/newRSS;
+		if(log) *log << ", halved";
+	}
+	lastStep = normInf;
+	if(log) *log << ", RSS: " << newRSS << ", RMS: " << std::sqrt(newRSS/m) << ", Gain: " << gain;
+	if(gain > 0 || (usedAlgorithm == GaussNewton && !monotone)){
+		// positive gain or GaussNewton: 
+		// Store modified variables permanently, current RSS to res, and reduce lamda.
+		storeVariables(delta, scale);
 		std::swap(workspace, res); lastRSS = newRSS;
 		lamda *= sqrt(0.1);
 	} else {
@@ -333,11 +1441,606 @@ double Estimator::optimizeStep(){
 		lamda *= sqrt(10.0);
 		lastRSS = -lastRSS; // old res got overwritten and has to be recalculated
 	}
+	if(log){
+		if(usedAlgorithm != GaussNewton){
+			*log << ", lamda = " << lamda;
+		}
+		*log << std::endl;
+	}
+	return gain;
+}
+
+double Estimator::reuseStep(){
+	assert(jacobian && numeric);
+	SLOM_STAT(stepStats.clear());
+	int m=jacobian->m, n=jacobian->n;
+
+	if(lastRSS < 0){
+		lastRSS = evaluate(res);
+	}
+	if(log) *log << lastRSS << " (last factorization)";
 	if(usedAlgorithm != GaussNewton){
-		std::cout << ", lamda = " << lamda;
+		std::fill(res + m-n, res+m, 0);
+	}
+	lastGradient = gradientNorm();
+
+	double* delta = usedAlgorithm == GaussNewton ? res : res + m-n;
+	switch(usedSolver){
+	case QR:
+		qrBackSolve(delta);
+		break;
+	case Cholesky:
+		{
+			// J^T res with the last Jacobian:
+			PhaseTimer timer(stepStats.time[StepStats::Assembly]);
+			for(int c=0; c<n; c++){
+				double g = 0;
+				for(int k=jacobian->p[c]; k<jacobian->p[c+1]; k++){
+					g += jacobian->x[k] * res[jacobian->i[k]];
+				}
+				workspace[c] = g;
+			}
+		}
+		choleskyBackSolve(delta);
+		break;
+	case Submaps:
+	case PCG:
+		assert(!"the Submaps and PCG solvers keep no factorization");
+		break;
+	}
+	double gain = takeStep(delta);
+	finishStep();
+	return gain;
+}
+
+/**
+ * Maximal number of times the step length of LBFGS is halved.
+ */
+static const int MAX_BACKTRACKS = 30;
+
+/**
+ * Fraction of the decrease predicted by the gradient a LBFGS step has to
+ * achieve (Armijo condition).
+ */
+static const double SUFFICIENT_DECREASE = 1e-4;
+
+double Estimator::lbfgsDirection(){
+	int n = gradient.size();
+	int pairs = std::min(historyCount, historySize);
+	std::vector<double> alpha(pairs);
+	double *q = &direction[0];
+	std::copy(gradient.begin(), gradient.end(), q);
+	// two-loop recursion, newest pair first:
+	for(int k=0; k<pairs; k++){
+		int slot = (historyCount-1-k) % historySize;
+		const double *s = &historyS[long(slot)*n], *y = &historyY[long(slot)*n];
+		alpha[k] = historyRho[slot] * std::inner_product(s, s+n, q, 0.0);
+		for(int c=0; c<n; c++) q[c] -= alpha[k] * y[c];
+	}
+	double gamma; // initial inverse Hessian gamma*I
+	if(pairs > 0){
+		int slot = (historyCount-1) % historySize;
+		const double *y = &historyY[long(slot)*n];
+		gamma = 1 / (historyRho[slot] * std::inner_product(y, y+n, y, 0.0));
+	} else {
+		// no curvature known yet, no variable is moved by more than 1:
+		double norm = n ? std::abs(*std::max_element(q, q+n, absCmp)) : 0;
+		gamma = norm > 0 ? 1/norm : 0;
+	}
+	for(int c=0; c<n; c++) q[c] *= gamma;
+	for(int k=pairs-1; k>=0; k--){
+		int slot = (historyCount-1-k) % historySize;
+		const double *s = &historyS[long(slot)*n], *y = &historyY[long(slot)*n];
+		double beta = historyRho[slot] * std::inner_product(y, y+n, q, 0.0);
+		for(int c=0; c<n; c++) q[c] += (alpha[k] - beta) * s[c];
+	}
+	return std::inner_product(gradient.begin(), gradient.end(), q, 0.0);
+}
+
+/**
+ * The history pairs are differences of steps and gradients in the tangent
+ * spaces of successive linearization points, which is a good approximation
+ * as long as the steps are small.
+ */
+double Estimator::lbfgsStep(){
+	SLOM_STAT(stepStats.clear());
+	int m = measurements.getDim(), n = variables.getDim();
+	if(lastRSS < 0){
+		lastRSS = evaluate(res);
+	}
+	if(log) *log << lastRSS;
+	calculateGradient();
+	lastGradient = n ? std::abs(*std::max_element(gradient.begin(), gradient.end(), absCmp)) : 0;
+	
+	// complete the pair of the last step, if the curvature is positive:
+	if(historyPending){
+		int slot = historyCount % historySize;
+		const double *s = &historyS[long(slot)*n];
+		double *y = &historyY[long(slot)*n];
+		for(int c=0; c<n; c++) y[c] = gradient[c] - previousGradient[c];
+		double ys = std::inner_product(y, y+n, s, 0.0);
+		if(ys > 0){
+			historyRho[slot] = 1/ys;
+			historyCount++;
+		}
+		historyPending = false;
+	}
+	
+	// backtracking line search, newRSS is evaluated into workspace:
+	double step = 1, newRSS = lastRSS;
+	bool accepted = false;
+	for(;;){
+		double slope;
+		{
+			PhaseTimer timer(stepStats.time[StepStats::Solve]);
+			slope = lbfgsDirection();
+		}
+		for(step = 1; slope > 0 && step >= std::ldexp(1.0, -MAX_BACKTRACKS); step *= 0.5){
+			addDelta(&direction[0], step);
+			newRSS = evaluate(workspace);
+			// the RSS is twice the objective, whose derivative along -direction is -slope:
+			if(newRSS <= lastRSS - 2*SUFFICIENT_DECREASE*step*slope){
+				accepted = true;
+				break;
+			}
+			for(IdxVector<IRVWrapper>::iterator v = variables.begin(); v!= variables.end(); v++){
+				(*v)->restore();
+			}
+		}
+		if(accepted || historyCount == 0) break;
+		// no descent along the L-BFGS direction, restart with the gradient:
+		historyCount = 0;
+	}
+	
+	double normInf = n ? step * std::abs(*std::max_element(direction.begin(), direction.end(), absCmp)) : 0;
+	double norm2 = step * step * std::inner_product(direction.begin(), direction.end(), direction.begin(), 0.0);
+	double gain = (lastRSS - newRSS)/newRSS;
+	if(log){
+		*log << ", Update: rms: " << std::sqrt(norm2/n) << " normInf: " << normInf
+		     << ", RSS: " << newRSS << ", RMS: " << std::sqrt(newRSS/m) << ", Gain: " << gain 
+		     << ", history: " << std::min(historyCount, historySize) << std::endl;
+	}
+	if(!accepted){
+		// the variables are unchanged and res is still valid:
+		lastStep = 0;
+		return 0;
+	}
+	storeVariables(&direction[0], step);
+	std::swap(workspace, res); lastRSS = newRSS;
+	lastStep = normInf;
+	// addDelta() moves the variables by -direction*step:
+	double *s = &historyS[long(historyCount % historySize)*n];
+	for(int c=0; c<n; c++) s[c] = -step * direction[c];
+	previousGradient.swap(gradient);
+	historyPending = true;
+	return gain;
+}
+
+static long matrixBytes(const cs *A){
+	return A ? A->nzmax*long(sizeof(int)+sizeof(double)) + (A->n+1)*long(sizeof(int)) : 0;
+}
+
+long Estimator::workspaceBytes() const{
+	long m = jacobian ? jacobian->m : measurements.getDim(), n = variables.getDim();
+	long bytes = matrixBytes(jacobian) + matrixBytes(JtJ);
+	if(numeric && !(outOfCore && outOfCore->owns(numeric))){ // a factor out of core is not counted
+		bytes += matrixBytes(numeric->L) + matrixBytes(numeric->U);
+	}
+	if(submapSolver){
+		bytes += submapSolver->getFactorNonZeros()*long(sizeof(int)+sizeof(double));
+	}
+	if(subgraphSolver){
+		bytes += subgraphSolver->getFactorNonZeros()*long(sizeof(int)+sizeof(double)) 
+				+ 5*n*long(sizeof(double)); // CG vectors
+	}
+	bytes += (2*m + n)*long(sizeof(double)); // res, workspace, cholCovariance
+	bytes += long(dampingValues.capacity() + dampingDeltas.capacity()
+			+ dampingWork.capacity() + dampingRhs.capacity())*long(sizeof(double));
+	bytes += long(historyS.capacity() + historyY.capacity() + historyRho.capacity() + gradient.capacity()
+			+ previousGradient.capacity() + direction.capacity())*long(sizeof(double));
+	return bytes;
+}
+
+/**
+ * Completes the statistics of the current step and calls the callback.
+ */
+void Estimator::finishStep(){
+#ifndef SLOM_NO_STATS
+	stepStats.steps = 1;
+	stepStats.nnzJ = jacobian ? jacobian->p[jacobian->n] : 0;
+	stepStats.bytes = workspaceBytes();
+	totalStats.add(stepStats);
+#endif
+	if(stepCallback) stepCallback(*this, stepStats, stepCallbackArg);
+}
+
+
+struct Estimator::DampingBody {
+	Estimator *estimator;
+	void operator()(int k) const {
+		estimator->solveDamped(k);
+	}
+};
+
+void Estimator::solveDamped(int k){
+	int m=jacobian->m, n=jacobian->n;
+	double lam = dampingLamdas[k];
+	double *delta = &dampingDeltas[k*n];
+	int stride = usedSolver == QR ? std::max(m, int(symbolic->m2)) : m;
+	double *work = &dampingWork[k*stride];
+	// a copy of the matrix with its own values and the damping of candidate k:
+	cs A = usedSolver == QR ? *jacobian : *JtJ;
+	A.x = &dampingValues[k*A.p[n]];
+	std::copy(usedSolver == QR ? jacobian->x : JtJ->x, 
+			(usedSolver == QR ? jacobian->x : JtJ->x) + A.p[n], A.x);
+	for(int c=0; c<n; c++){
+		double d = usedAlgorithm == Levenberg ? lam : lam*cholCovariance[c];
+		if(usedSolver == QR){
+			A.x[A.p[c+1]-1] = d;
+		} else {
+			A.x[A.p[c+1]-1] += d*d;
+		}
+	}
+	
+	csn *N = 0;
+	switch(usedSolver){
+	case QR:
+		N = cs_qr(&A, symbolic);
+		if(!N) break;
+		// as in qrSolve():
+		cs_ipvec(symbolic->pinv, res, work, m);
+		for (int j = 0; j < n; j++){
+			cs_happly(N->L, j, N->B[j], work);
+		}
+		cs_usolve(N->U, work);
+		cs_ipvec(symbolic->q, work, delta, n);
+		break;
+	case Cholesky:
+		N = cs_chol(&A, symbolic);
+		if(!N) break;
+		// as in choleskySolve():
+		cs_ipvec(symbolic->pinv, &dampingRhs[0], work, n);
+		cs_lsolve(N->L, work);
+		cs_ltsolve(N->L, work);
+		cs_pvec(symbolic->pinv, work, delta, n);
+		break;
+	case Submaps:
+		std::copy(dampingRhs.begin(), dampingRhs.end(), delta);
+		dampingOk[k] = submapSolver->solve(&A, delta, *pool);
+		if(k == 0){
+			SLOM_STAT(stepStats.nnzL = submapSolver->getFactorNonZeros());
+		}
+		return;
+	case PCG:
+		std::copy(dampingRhs.begin(), dampingRhs.end(), delta);
+		dampingOk[k] = pcgSolveSystem(&A, delta, work, k == 0);
+		return;
+	}
+	if(k == 0 && N){
+		SLOM_STAT(stepStats.nnzL = usedSolver == QR ? N->U->p[n] : N->L->p[n]);
+	}
+	dampingOk[k] = N != 0;
+	dampingFactors[k] = N;
+}
+
+double Estimator::speculativeStep(){
+	int m=jacobian->m, n=jacobian->n;
+	
+	calculateJacobian();
+	if(lastRSS < 0){
+		lastRSS = evaluate(res);
+	}
+	if(log) *log << lastRSS;
+	std::fill(res + m-n, res+m, 0);
+	lastGradient = gradientNorm();
+	
+	// lamda values around the current one:
+	dampingLamdas.resize(numDampings);
+	for(int k=0; k<numDampings; k++){
+		dampingLamdas[k] = lamda * std::pow(dampingFactor, k - numDampings/2);
+	}
+	int values = usedSolver == QR ? jacobian->p[n] : JtJ->p[n];
+	dampingValues.resize(numDampings*values);
+	dampingDeltas.resize(numDampings*n);
+	int stride = usedSolver == QR ? std::max(m, int(symbolic->m2)) : m;
+	dampingWork.resize(numDampings*stride);
+	dampingOk.resize(numDampings);
+	dampingFactors.assign(numDampings, (csn*)0);
+	if(usedSolver != QR){
+		dampingRhs.resize(n);
+		assembleNormalEquations(&dampingRhs[0], false);
+	}
+	
+	DampingBody body = {this};
+	{
+		// factorizations and solves of all candidates:
+		PhaseTimer timer(stepStats.time[StepStats::Factorization]);
+		if(usedSolver == Submaps || usedSolver == PCG){
+			// the SubmapSolver and SubgraphSolver have one workspace
+			for(int k=0; k<numDampings; k++) body(k);
+		} else {
+			pool->parallelFor(numDampings, body);
+		}
+	}
+	
+	// Evaluate the candidates one after another, as they share the variables,
+	// each evaluation is parallel itself.
+	// The residual of candidate k is stored in its part of dampingWork.
+	int best = -1;
+	double bestRSS = lastRSS, minRSS = -1;
+	for(int k=0; k<numDampings; k++){
+		if(!dampingOk[k]) continue;
+		addDelta(&dampingDeltas[k*n]);
+		double rss = evaluate(&dampingWork[k*stride]);
+		for(IdxVector<IRVWrapper>::iterator v = variables.begin(); v!= variables.end(); v++){
+			(*v)->restore();
+		}
+		if(minRSS < 0 || rss < minRSS) minRSS = rss;
+		if(rss < bestRSS){
+			best = k;
+			bestRSS = rss;
+		}
+	}
+	double gain = minRSS < 0 ? -1 : (lastRSS - minRSS)/minRSS;
+	// the step taken, or the smallest step tried:
+	const double *step = &dampingDeltas[(best >= 0 ? best : numDampings-1)*n];
+	lastStep = std::abs(*std::max_element(step, step+n, absCmp));
+	if(log) *log << ", Lamdas: " << numDampings << ", RSS: " << minRSS << ", Gain: " << gain;
+	// keep the factor of the step taken for reuseStep(), the old one is outdated:
+	releaseFactor();
+	if(best >= 0){
+		std::swap(numeric, dampingFactors[best]);
+	}
+	for(int k=0; k<numDampings; k++){
+		dampingFactors[k] = cs_nfree(dampingFactors[k]);
+	}
+	if(best >= 0){
+		// take the best step and reduce its lamda:
+		addDelta(&dampingDeltas[best*n]);
+		storeVariables(&dampingDeltas[best*n]);
+		std::copy(&dampingWork[best*stride], &dampingWork[best*stride] + (m-n), res);
+		lastRSS = bestRSS;
+		lamda = dampingLamdas[best] * sqrt(0.1);
+	} else {
+		// no improvement: continue above the largest lamda tried
+		lamda = dampingLamdas.back() * sqrt(10.0);
+	}
+	if(log){
+		*log << ", lamda = " << lamda << std::endl;
 	}
-	std::cout << std::endl;
 	return gain;
 }
 
+
+static double secondsSince(const struct timeval &start){
+	struct timeval now;
+	gettimeofday(&now, 0);
+	return (now.tv_sec-start.tv_sec) + 1e-6*(now.tv_usec-start.tv_usec);
+}
+
+/**
+ * Checks the tolerances after a step with gain, except for the time.
+ */
+bool Estimator::converged(double gain, const Tolerances &tol, StopReason &reason) const{
+	if(tol.gradient > 0 && lastGradient < tol.gradient){
+		reason = Gradient;
+		return true;
+	}
+	if(tol.rss > 0 && gain >= 0 && gain/(1+gain) < tol.rss){
+		reason = RSSDecrease;
+		return true;
+	}
+	if(tol.step > 0 && lastStep < tol.step){
+		reason = StepSize;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Whether Gauss-Newton can not make a step, as a variable has no
+ * measurement.
+ */
+bool Estimator::singular(StopReason &reason) const{
+	if(unconstrained == 0 || usedAlgorithm != GaussNewton) return false;
+	reason = Unconstrained;
+	return true;
+}
+
+Estimator::StopReason Estimator::optimize(int maxIterations, const Tolerances &tol){
+	struct timeval start;
+	gettimeofday(&start, 0);
+	StopReason reason = MaxIterations;
+	for(iterations=0; iterations<maxIterations; ){
+		if(singular(reason)) break;
+		if(log) *log << "Step " << iterations+1 << ": ";
+		double gain = optimizeStep();
+		iterations++;
+		if(converged(gain, tol, reason)) break;
+		if(tol.seconds > 0 && secondsSince(start) >= tol.seconds){
+			reason = TimeLimit;
+			break;
+		}
+	}
+	if(log) *log << "Stopped after " << iterations << " steps: " << stopReasonName(reason) << std::endl;
+	return reason;
+}
+
+Estimator::StopReason Estimator::optimizeWithin(double seconds, int maxIterations, const Tolerances &tol){
+	struct timeval start, stepStart;
+	gettimeofday(&start, 0);
+	monotone = true;
+	bool reuseUseless = false;
+	StopReason reason = MaxIterations;
+	for(iterations=0; iterations<maxIterations; ){
+		if(singular(reason)) break;
+		double remaining = seconds - secondsSince(start);
+		// a step without relinearization costs the full step without the
+		// Jacobian, assembly and factorization:
+		double reuseEstimate = reuseStepTime >= 0 ? reuseStepTime : fullStepTime * (1-reuseSaving);
+		bool full = fullStepTime < 0 ? remaining > 0 : fullStepTime <= remaining;
+		bool reuse = !full && !reuseUseless && numeric && usedSolver != Submaps 
+				&& usedSolver != PCG && fullStepTime >= 0 && reuseEstimate <= remaining;
+		if(!full && !reuse){
+			reason = TimeLimit;
+			break;
+		}
+		
+		if(log) *log << "Step " << iterations+1 << ": ";
+		gettimeofday(&stepStart, 0);
+		double gain = full ? optimizeStep() : reuseStep();
+		iterations++;
+		if(full){
+			fullStepTime = secondsSince(stepStart);
+#ifndef SLOM_NO_STATS
+			const double *t = stepStats.time;
+			reuseSaving = (t[StepStats::Jacobian] + t[StepStats::Damping] + t[StepStats::Assembly]
+					+ t[StepStats::Factorization]) / std::max(stepStats.totalTime(), 1e-9);
+#endif
+		} else {
+			reuseStepTime = secondsSince(stepStart);
+		}
+		
+		if(converged(gain, tol, reason)) break;
+		// after a rejected step the variables did not change, 
+		// the last factorization would give the same step again:
+		reuseUseless = gain <= 0;
+		if(gain <= 0 && full && usedAlgorithm == GaussNewton){
+			reason = RSSDecrease;
+			break;
+		}
+	}
+	monotone = false;
+	if(log) *log << "Stopped after " << iterations << " steps: " << stopReasonName(reason) << std::endl;
+	return reason;
+}
+
+bool Estimator::measurementOrder(const IMeasurement *a, const IMeasurement *b){
+	return a->idx < b->idx;
+}
+
+bool Estimator::variableOrder(const IRVWrapper *a, const IRVWrapper *b){
+	return a->idx < b->idx;
+}
+
+void Estimator::updateMeasurementVariables() const{
+	registrationsSeen.resize(variables.size(), 0);
+	for(size_t v=0; v<variables.size(); v++){
+		const IRVWrapper *var = variables[v];
+		for(IRVWrapper::const_iterator meas = var->begin() + registrationsSeen[v]; meas != var->end(); meas++){
+			std::vector<const IRVWrapper*> &vars = measurementVariables[*meas];
+			if(vars.empty() || vars.back() != var) vars.push_back(var);
+		}
+		registrationsSeen[v] = var->size();
+	}
+}
+
+void Estimator::selectRegion(const std::vector<RVId> &seeds, int hops, std::vector<RVId> &region) const{
+	updateMeasurementVariables();
+	std::set<RVId> visited;
+	std::vector<RVId> front, next;
+	for(size_t k=0; k<seeds.size(); k++){
+		if(seeds[k]->optimize && visited.insert(seeds[k]).second){
+			front.push_back(seeds[k]);
+		}
+	}
+	region.insert(region.end(), front.begin(), front.end());
+	// breadth-first search over the measurements:
+	for(int h=0; h<hops && !front.empty(); h++){
+		next.clear();
+		for(size_t k=0; k<front.size(); k++){
+			for(IRVWrapper::const_iterator meas = front[k]->begin(); meas != front[k]->end(); meas++){
+				std::map<const IMeasurement*, std::vector<const IRVWrapper*> >::const_iterator it = 
+					measurementVariables.find(*meas);
+				if(it == measurementVariables.end()) continue;
+				for(size_t j=0; j<it->second.size(); j++){
+					if(visited.insert(it->second[j]).second){
+						next.push_back(it->second[j]);
+					}
+				}
+			}
+		}
+		region.insert(region.end(), next.begin(), next.end());
+		front.swap(next);
+	}
+}
+
+void Estimator::selectChanged(double threshold, std::vector<RVId> &region) const{
+	for(IdxVector<IRVWrapper>::const_iterator v = variables.begin(); v!= variables.end(); v++){
+		if((*v)->optimize && (*v)->change > threshold) region.push_back(*v);
+	}
+}
+
+Estimator::StopReason Estimator::optimizeRegion(const std::vector<RVId> &region, int maxIterations, const Tolerances &tol){
+	// the variables of the region in the order of the whole problem:
+	std::vector<IRVWrapper*> regionVars;
+	for(size_t k=0; k<region.size(); k++){
+		if(region[k]->optimize && region[k]->registered){
+			regionVars.push_back(const_cast<IRVWrapper*>(region[k]));
+		}
+	}
+	std::sort(regionVars.begin(), regionVars.end(), variableOrder);
+	regionVars.erase(std::unique(regionVars.begin(), regionVars.end()), regionVars.end());
+	if(regionVars.empty()){
+		iterations = 0;
+		return StepSize; // nothing to move
+	}
+	
+	// all measurements of these variables and their non-zeroes:
+	std::vector<IMeasurement*> regionMeas;
+	int regionNnz = 0;
+	for(size_t v=0; v<regionVars.size(); v++){
+		int rows = 0;
+		for(IRVWrapper::const_iterator meas = regionVars[v]->begin(); meas != regionVars[v]->end(); meas++){
+			if(!ownMeasurement(*meas)) continue;
+			regionMeas.push_back(const_cast<IMeasurement*>(*meas));
+			rows += (*meas)->getDim();
+		}
+		regionNnz += rows * regionVars[v]->getDOF();
+	}
+	std::sort(regionMeas.begin(), regionMeas.end(), measurementOrder);
+	regionMeas.erase(std::unique(regionMeas.begin(), regionMeas.end()), regionMeas.end());
+	
+	// optimize the region as if it was the whole problem:
+	IdxVector<IRVWrapper> allVariables(variables);
+	IdxVector<IMeasurement> allMeasurements(measurements);
+	int allNnz = nnz;
+	variables.clear();
+	measurements.clear();
+	for(size_t v=0; v<regionVars.size(); v++) variables.push_back(regionVars[v]);
+	for(size_t m=0; m<regionMeas.size(); m++) measurements.push_back(regionMeas[m]);
+	nnz = regionNnz;
+	
+	// regions are too many and too short lived for the ordering cache:
+	std::string cache;
+	cache.swap(orderingCache);
+	initialize();
+	orderingCache.swap(cache);
+	StopReason reason = optimize(maxIterations, tol);
+	
+	// back to the whole problem, this restores the indices:
+	variables.clear();
+	measurements.clear();
+	for(IdxVector<IRVWrapper>::iterator v = allVariables.begin(); v!= allVariables.end(); v++){
+		variables.push_back(*v);
+	}
+	for(IdxVector<IMeasurement>::iterator m = allMeasurements.begin(); m!= allMeasurements.end(); m++){
+		measurements.push_back(*m);
+	}
+	nnz = allNnz;
+	return reason;
+}
+
+const char* Estimator::stopReasonName(StopReason reason){
+	switch(reason){
+	case MaxIterations: return "maximal number of iterations";
+	case Gradient:      return "gradient below tolerance";
+	case StepSize:      return "step size below tolerance";
+	case RSSDecrease:   return "RSS decrease below tolerance";
+	case TimeLimit:     return "time limit";
+	case Unconstrained: return "variable without measurement";
+	}
+	return "unknown";
+}
+
 }  // namespace SLOM
@@ -6,6 +6,16 @@
 #include "types/Measurement.h"
 
 #include "types/IdxVector.h"
+#include "tools/ThreadPool.h"
+#include "tools/StepStats.h"
+#include "SubmapSolver.h"
+#include "SubgraphSolver.h"
+#include "OutOfCoreCholesky.h"
+
+#include <vector>
+#include <map>
+#include <string>
+#include <iostream>
 
 #include <cs.h>
 
@@ -17,13 +27,38 @@ public:
 	enum Algorithm{ // use the following "damping term" $N$ in $(J^T J + N)\delta = J^T [y - f(\beta)]}$
 		GaussNewton,       // $N=0$
 		Levenberg,         // $N= \lambda*I$
-		LevenbergMarquardt // $N= \lambda*diag(J^T J)$
+		LevenbergMarquardt, // $N= \lambda*diag(J^T J)$
+		LBFGS // no linear system, limited-memory BFGS on the gradient $J^T r$, see setHistorySize()
 	};
 	
 	enum Solver{
 		QR,
-		Cholesky
+		Cholesky,
+		Submaps, // nested dissection into submaps, solved in parallel, see SubmapSolver
+		PCG      // conjugate gradients with a spanning tree preconditioner, see SubgraphSolver
+	};
+	
+	/**
+	 * Stopping criteria of optimize(). Criteria <= 0 are not checked.
+	 */
+	struct Tolerances {
+		double gradient; // infinity norm of $J^T r$ at the start of a step
+		double step;     // infinity norm of the update, in the tangent space
+		double rss;      // relative RSS decrease of an accepted step
+		double seconds;  // wall-clock budget
+		Tolerances(double rss=1e-9) : gradient(0), step(0), rss(rss), seconds(0) {}
+	};
+	
+	enum StopReason{
+		MaxIterations,
+		Gradient,
+		StepSize,
+		RSSDecrease,
+		TimeLimit,
+		Unconstrained // a variable has no measurement, Gauss-Newton can not make a step
 	};
+	
+	typedef void (*StepCallback)(const Estimator &e, const StepStats &stats, void *arg);
 private:
 	
 	enum Algorithm usedAlgorithm;
@@ -37,21 +72,93 @@ private:
 	// the big matrix:
 	int nnz; // number of non-zeroes in Jacobian
 	cs* jacobian;
-	cs* JtJ;  // $J^T J$ for CholeskySolve, this is also the information matrix
+	cs* JtJ;  // upper triangle of $J^T J$ for CholeskySolve, this is also the information matrix
 	
 	css* symbolic; // symbolic decomposition of jacobian or JtJ 
 	csn* numeric;  // numeric decomposition of jacobian or JtJ
 	
+	// Cholesky factors larger than inCoreBudget bytes are stored in outOfCoreDirectory:
+	OutOfCoreCholesky *outOfCore;
+	std::string outOfCoreDirectory;
+	long inCoreBudget;
+	
+	SubmapSolver *submapSolver; // partition and decompositions of JtJ for the Submaps solver
+	int maxSubmapSize;          // maximal number of variables in a submap
+	
+	SubgraphSolver *subgraphSolver; // preconditioner and workspace of the PCG solver
+	double pcgTolerance;            // relative residual at which CG stops
+	int pcgMaxIterations;
+	double subgraphExtraEdges;      // couplings added to the spanning tree per variable
+	
 	// the current residuum:
 	double *res;
 	
 	// workspace for solving:
 	double *workspace;
 	
+	// structure of the problem, set up by createSparse():
+	int maxDOF;    // largest DOF of any variable
+	int maxColumn; // largest number of measurement rows in a column
+	int unconstrained; // variables without any measurement
+	/**
+	 * Indices of variables grouped by color. Variables of the same color
+	 * share no measurement, so their columns can be calculated concurrently.
+	 */
+	std::vector<std::vector<int> > variableColors;
+	/**
+	 * Whether some variable also has measurements of another estimator.
+	 * They have no rows in this estimator's Jacobian.
+	 */
+	bool foreignMeasurements;
+	
+	/**
+	 * How a measurement enters the Jacobian and JtJ.
+	 * vars are the indices of the variables it depends on in ascending order,
+	 * rows[k] is the offset of its rows in the Jacobian columns of vars[k].
+	 * For i<=j blocks[j*(j+1)/2+i] is the offset of the rows of vars[i]
+	 * in the JtJ columns of vars[j] (not set up for the QR solver).
+	 */
+	struct MeasurementStructure {
+		std::vector<int> vars, rows, blocks;
+	};
+	std::vector<MeasurementStructure> measurementStructure;
+	
+	/**
+	 * Indices of measurements grouped by color. Measurements of the same
+	 * color share no variable, so they can be added to JtJ concurrently.
+	 */
+	std::vector<std::vector<int> > measurementColors;
+	
+	// per thread buffers for calculateJacobian:
+	double *perturbation; // maxDOF values, all zero between uses
+	double *columnBuffer; // maxColumn values
+	
 	
 	// lamda parameter for LMA:
 	double lamda; 
 	
+	// speculative damping, see setSpeculativeDamping():
+	int numDampings;      // number of lamda values tried per step
+	double dampingFactor; // ratio of neighboring lamda values
+	std::vector<double> dampingLamdas;
+	std::vector<double> dampingValues; // matrix values of each candidate
+	std::vector<double> dampingDeltas; // step of each candidate
+	std::vector<double> dampingWork;   // solver workspace, then residual of each candidate
+	std::vector<double> dampingRhs;    // J^T res
+	std::vector<char> dampingOk;       // the candidate could be solved
+	std::vector<csn*> dampingFactors;  // factor of each candidate, QR and Cholesky only
+	
+	// LBFGS, the only workspace besides res and workspace:
+	int historySize;                      // number of stored step/gradient change pairs
+	int historyCount;                     // pairs stored so far, the newest is at (historyCount-1)%historySize
+	bool historyPending;                  // the last step is stored, but not yet its gradient change
+	std::vector<double> historyS;         // steps, historySize*n values
+	std::vector<double> historyY;         // changes of the gradient
+	std::vector<double> historyRho;       // $1/(y^T s)$ of each pair
+	std::vector<double> gradient;         // $J^T r$ at the current variables
+	std::vector<double> previousGradient; // $J^T r$ before the last step
+	std::vector<double> direction;        // the variables are moved by -direction*step length
+	
 	
 	/** the cholesky factor of the current covariance.
 	 */
@@ -60,35 +167,196 @@ private:
 	/** the last Residual Sum of Squares
 	 */
 	double lastRSS;
+	
+	/** thread pool for all parallel phases
+	 */
+	ThreadPool *pool;
+	
+	/**
+	 * Shape of the problem the workspace was created for, see computeShape().
+	 */
+	std::vector<int> shape;
+	void computeShape(std::vector<int> &shape) const;
+	void symbolicSizes(int sizes[5]) const;
+	
+	/**
+	 * Directory of cached orderings, empty if disabled, see setOrderingCache().
+	 */
+	std::string orderingCache;
+	std::string orderingFile(const std::vector<int> &shape) const;
+	css* loadOrdering(const std::vector<int> &shape) const;
+	void saveOrdering(const std::vector<int> &shape) const;
+	
+	/** progress of optimizeStep() is written here, if set
+	 */
+	std::ostream *log;
+	
+	// timings and counters of the current step and since initialize():
+	mutable StepStats stepStats;
+	StepStats totalStats;
+	StepCallback stepCallback;
+	void *stepCallbackArg;
+	void finishStep();
+	long workspaceBytes() const;
+	
+	// of the last step, for optimize():
+	double lastGradient;  // infinity norm of $J^T r$
+	double lastStep;      // infinity norm of the update
+	int iterations;       // steps done by the last optimize()
+	double gradientNorm() const;
+	/**
+	 * Stores the variables after an accepted step delta*scale and 
+	 * records the size of their update.
+	 */
+	void storeVariables(const double *delta, double scale=1);
+	bool converged(double gain, const Tolerances &tol, StopReason &reason) const;
+	bool singular(StopReason &reason) const;
+	
+	// for optimizeWithin():
+	bool monotone;        // only keep steps which reduce the RSS, also for Gauss-Newton
+	double fullStepTime;  // duration of the last optimizeStep(), -1 if unknown
+	double reuseStepTime; // duration of the last reuseStep(), -1 if unknown
+	double reuseSaving;   // fraction of a full step not needed by reuseStep()
+	
+	/**
+	 * Adds delta to the variables, keeps them if the step is accepted 
+	 * and adapts lamda. Returns the gain.
+	 */
+	double takeStep(const double *delta);
+	
+	/**
+	 * A step with the Jacobian and factorization of the last step,
+	 * i.e. without relinearization. Not possible for the Submaps and PCG
+	 * solvers, which keep no factorization.
+	 */
+	double reuseStep();
+	
+	struct EvalBody;
+	struct JacobianBody;
+	struct AssemblyBody;
+	struct DampingBody;
+	struct GradientBody;
+	double evalChunk(double *result, int chunk) const;
+	void jacobianColumns(int var);
+	/**
+	 * Sets up measurementStructure and colors variables and measurements.
+	 */
+	void analyzeStructure();
+	/**
+	 * Whether meas has been inserted into this estimator.
+	 */
+	bool ownMeasurement(const IMeasurement *meas) const;
+	static bool measurementBefore(const IMeasurement *m, int idx);
+	static bool measurementOrder(const IMeasurement *a, const IMeasurement *b);
+	static bool variableOrder(const IRVWrapper *a, const IRVWrapper *b);
+	
+	// the variables of each measurement, for selectRegion().
+	// Updated incrementally, registrationsSeen[v] measurements of variable v are included:
+	mutable std::map<const IMeasurement*, std::vector<const IRVWrapper*> > measurementVariables;
+	mutable std::vector<int> registrationsSeen;
+	void updateMeasurementVariables() const;
+	void allocateThreadBuffers();
 
 	
 	/**
 	 * Creates "the big matrix", 
+	 * uses ordering as symbolic decomposition if given.
 	 */
-	void createSparse();
+	void createSparse(css *ordering=0);
 	void updateSparse();
 	void updateDiagonal();
 	void freeWorkspace();
 	void qrSolve(double* delta);
+	void qrBackSolve(double* delta);
 	void choleskySolve(double* delta);
+	void choleskyBackSolve(double* delta);
+	/**
+	 * cs_chol() of JtJ, or out of core if the factor exceeds inCoreBudget.
+	 */
+	csn* choleskyFactorize();
+	/**
+	 * Frees numeric, unless it belongs to outOfCore.
+	 */
+	void releaseFactor();
+	void addDelta(const double *delta, double scale=1);
+	
+	/**
+	 * optimizeStep() with numDampings lamda values for one linearization.
+	 * The factor of the accepted candidate becomes numeric.
+	 */
+	double speculativeStep();
+	/**
+	 * Solves the damped system for candidate k into dampingDeltas.
+	 * Different candidates can be solved concurrently, except for Submaps.
+	 */
+	void solveDamped(int k);
+	
+	/**
+	 * Creates the structure of JtJ.
+	 */
+	void createNormalEquations();
+	void createSubmaps();
+	void submapSolve(double* delta);
+	void createSubgraph();
+	bool pcgSolve(double* delta);
+	bool pcgSolveSystem(const cs *A, double *b, double *work, bool stats);
+	/**
+	 * The solver uses a fill-reducing ordering, which can be stored.
+	 */
+	bool hasOrdering() const {
+		return usedAlgorithm != LBFGS && (usedSolver == QR || usedSolver == Cholesky);
+	}
+	
+	/**
+	 * Calculates JtJ and rhs = J^T res. Measurements of the same color are 
+	 * added in parallel, colors one after another.
+	 * The damping term is added if addDamping is set.
+	 */
+	void assembleNormalEquations(double *rhs, bool addDamping=true);
+	void assembleMeasurement(int meas, double *rhs);
 
 	/**
 	 * Numerically calculates the Jacobian of the function with the 
 	 * and updates cholCovariance. The result is stored in matrix.
+	 * Columns of variables with the same color are calculated in parallel.
 	 */
 	void calculateJacobian();
 	
+	/**
+	 * For LBFGS: sets up res, workspace and the history, but no matrices.
+	 */
+	void createGradientWorkspace();
+	/**
+	 * Calculates gradient from res by numerical differentiation of each 
+	 * measurement, without storing the Jacobian.
+	 */
+	void calculateGradient();
+	void gradientEntries(int var);
+	/**
+	 * A step along the L-BFGS direction with a backtracking line search.
+	 */
+	double lbfgsStep();
+	/**
+	 * Stores direction = H gradient, with H the L-BFGS approximation of the
+	 * inverse of $J^T J$. Returns $gradient^T direction$.
+	 */
+	double lbfgsDirection();
+	
 	void initCovariance();
 	
 public:
 	
 	Estimator(Algorithm alg=GaussNewton, double lamda0=1e-3) : 
 		usedAlgorithm(alg), usedSolver(Cholesky),
-		nnz(0), jacobian(0), JtJ(0), symbolic(0), numeric(0), res(0), workspace(0), lamda(lamda0), cholCovariance(0) {};
+		nnz(0), jacobian(0), JtJ(0), symbolic(0), numeric(0), outOfCore(0), inCoreBudget(0), submapSolver(0), maxSubmapSize(256), subgraphSolver(0), pcgTolerance(1e-6), pcgMaxIterations(1000), subgraphExtraEdges(0.05), res(0), workspace(0), maxDOF(0), maxColumn(0), unconstrained(0), foreignMeasurements(false), perturbation(0), columnBuffer(0),
+		lamda(lamda0), numDampings(1), dampingFactor(10), historySize(8), historyCount(0), historyPending(false), cholCovariance(0), pool(new ThreadPool()), log(0), stepCallback(0), stepCallbackArg(0), lastGradient(0), lastStep(0), iterations(0),
+		monotone(false), fullStepTime(-1), reuseStepTime(-1), reuseSaving(0) {};
 
 	Estimator(Solver solver, Algorithm alg=GaussNewton, double lamda0=1e-3) : 
 		usedAlgorithm(alg), usedSolver(solver),
-		nnz(0), jacobian(0), JtJ(0), symbolic(0), numeric(0), res(0), workspace(0), lamda(lamda0), cholCovariance(0) {};
+		nnz(0), jacobian(0), JtJ(0), symbolic(0), numeric(0), outOfCore(0), inCoreBudget(0), submapSolver(0), maxSubmapSize(256), subgraphSolver(0), pcgTolerance(1e-6), pcgMaxIterations(1000), subgraphExtraEdges(0.05), res(0), workspace(0), maxDOF(0), maxColumn(0), unconstrained(0), foreignMeasurements(false), perturbation(0), columnBuffer(0),
+		lamda(lamda0), numDampings(1), dampingFactor(10), historySize(8), historyCount(0), historyPending(false), cholCovariance(0), pool(new ThreadPool()), log(0), stepCallback(0), stepCallbackArg(0), lastGradient(0), lastStep(0), iterations(0),
+		monotone(false), fullStepTime(-1), reuseStepTime(-1), reuseSaving(0) {};
 		
 	
 	
@@ -137,15 +405,162 @@ public:
 		cs_print(jacobian, brief);
 	}
 	
+	/**
+	 * Evaluates all measurements, stores the results in result and returns 
+	 * the sum of their squares. The sum does not depend on the number of threads.
+	 */
 	double evaluate(double *result) const;
 	
-	void initialize();
+	/**
+	 * Sets the number of threads used by the estimator, including the 
+	 * calling thread. With n==1 everything runs inline on the calling thread.
+	 * If pinThreads is set, the worker threads are bound to separate CPUs.
+	 * Measurements must be safe to evaluate concurrently if n>1.
+	 * The thread pool is resized, references from getThreadPool() stay
+	 * valid, but it must not be called while the pool runs tasks.
+	 */
+	void setNumThreads(int n, bool pinThreads=false);
+	
+	int getNumThreads() const {
+		return pool->getNumThreads();
+	}
+	
+	/**
+	 * The thread pool used by the estimator. Applications can use it
+	 * for their own tasks (e.g. parsing) to avoid oversubscription.
+	 * It lives as long as the estimator, setNumThreads() resizes it.
+	 */
+	ThreadPool& getThreadPool() {
+		return *pool;
+	}
+	
+	/**
+	 * Sets up the workspace for the current variables and measurements.
+	 * If the problem has the same shape as before, i.e. the same variable
+	 * DOFs, measurement dimensions and dependencies, the previous workspace 
+	 * is reused and true is returned.
+	 */
+	bool initialize();
+	
+	/**
+	 * Writes the state of the optimization to out in a binary format: the 
+	 * structure of the problem, the values of all variables (as coordinates
+	 * relative to their default value, see IRVWrapper::save()), lamda, the 
+	 * last RSS, the step timings and the fill-reducing ordering. With 
+	 * withFactor also the last Jacobian and numeric factor, so the next 
+	 * optimizeWithin() can reuse them.
+	 * Requires initialize(). Returns false on write errors.
+	 */
+	bool saveCheckpoint(std::ostream &out, bool withFactor=false) const;
+	
+	/**
+	 * Restores a checkpoint written by saveCheckpoint(), instead of 
+	 * initialize(). The same variables and measurements have to be inserted 
+	 * as when it was written, e.g. by parsing the same log again, their 
+	 * values are overwritten. Returns false if the checkpoint can not be 
+	 * read, does not fit the problem or contains invalid values or indices,
+	 * the Estimator is not changed then.
+	 */
+	bool loadCheckpoint(std::istream &in);
+	
+	/**
+	 * Removes all variables and measurements, to solve another problem with
+	 * the same Estimator. The workspace is kept for the next initialize().
+	 */
+	void clear();
 	
 	/**
 	 * Optimizes 
 	 */
 	double optimizeStep(); //TODO parameters
 	
+	/**
+	 * Calls optimizeStep() until one of the tolerances is met or after
+	 * maxIterations steps. Returns why it stopped. Gauss-Newton does no 
+	 * step if a variable has no measurement, see getUnconstrained().
+	 */
+	StopReason optimize(int maxIterations, const Tolerances &tol=Tolerances());
+	
+	/**
+	 * Timings and counters of the last optimizeStep().
+	 * All zero if compiled with SLOM_NO_STATS.
+	 */
+	const StepStats& getStats() const {
+		return stepStats;
+	}
+	
+	/**
+	 * Timings and counters since the last initialize(), including the
+	 * symbolic analysis.
+	 */
+	const StepStats& getTotalStats() const {
+		return totalStats;
+	}
+	
+	/**
+	 * callback(*this, getStats(), arg) is called at the end of each 
+	 * optimizeStep(). 0 removes the callback.
+	 */
+	void setStepCallback(StepCallback callback, void *arg=0) {
+		stepCallback = callback;
+		stepCallbackArg = arg;
+	}
+	
+	/**
+	 * Anytime optimization: like optimize(), but only starts a step if it
+	 * is predicted to end within the given number of seconds. The duration
+	 * of the next step is predicted from the previous ones. If a full step
+	 * would take too long, a step with the last Jacobian and factorization
+	 * is done if that fits, except for the Submaps and PCG solvers.
+	 * Only steps which reduce the RSS are kept, so the variables always 
+	 * hold the best state found, rejected Gauss-Newton steps are halved
+	 * up to 8 times. tol.seconds is not used.
+	 * The duration of the first step after initialize() is not known, it 
+	 * is done if any time is left and can exceed the limit.
+	 */
+	StopReason optimizeWithin(double seconds, int maxIterations=50, 
+			const Tolerances &tol=Tolerances());
+	
+	/**
+	 * Number of variables without any measurement, counted by initialize().
+	 * They make the normal equations of Gauss-Newton singular, the 
+	 * damping of Levenberg(-Marquardt) keeps them in place.
+	 */
+	int getUnconstrained() const {
+		return unconstrained;
+	}
+	
+	/**
+	 * Number of steps done by the last optimize() or optimizeWithin().
+	 */
+	int getIterations() const {
+		return iterations;
+	}
+	
+	static const char* stopReasonName(StopReason reason);
+	
+	/**
+	 * Appends the variables within hops measurements of the seeds to region,
+	 * including the seeds themselves. Fixed variables are skipped.
+	 */
+	void selectRegion(const std::vector<RVId> &seeds, int hops, std::vector<RVId> &region) const;
+	
+	/**
+	 * Appends the variables whose last accepted update had an infinity norm
+	 * above threshold to region.
+	 */
+	void selectChanged(double threshold, std::vector<RVId> &region) const;
+	
+	/**
+	 * Local optimization: like optimize(), but only the variables in region 
+	 * are optimized and only their measurements are evaluated, all other 
+	 * variables are held fixed. The region gets its own workspace, so 
+	 * initialize() has to be called before optimizing the whole problem
+	 * again. getLastRSS() is the RSS of the region's measurements afterwards.
+	 */
+	StopReason optimizeRegion(const std::vector<RVId> &region, int maxIterations,
+			const Tolerances &tol=Tolerances());
+	
 	int getM() const {
 		return measurements.getDim();
 	}
@@ -158,6 +573,121 @@ public:
 		return lastRSS;
 	}
 	
+	/**
+	 * Has to be called if variables or measurements were modified outside
+	 * of optimizeStep(), so the residual is evaluated again.
+	 */
+	void invalidateResidual() {
+		lastRSS = -1;
+	}
+	
+	void setLamda(double lamdaNew) {
+		lamda = lamdaNew;
+	}
+	
+	/**
+	 * For Levenberg(-Marquardt): try n lamda values per step instead of one,
+	 * lamda*factor^k for k in [-n/2, n-n/2). They are solved in parallel for 
+	 * the same linearization, the step with the lowest RSS is taken and the 
+	 * next lamda is chosen around its lamda. n<=1 tries one lamda per step.
+	 */
+	void setSpeculativeDamping(int n, double factor=10) {
+		numDampings = n > 1 ? n : 1;
+		dampingFactor = factor > 1 ? factor : 10;
+	}
+	
+	/**
+	 * For LBFGS: the number of previous steps used to approximate the 
+	 * curvature. The memory needed is about 2*n*m doubles for n degrees of 
+	 * freedom. Takes effect at the next initialize().
+	 */
+	void setHistorySize(int m) {
+		historySize = m > 0 ? m : 1;
+		shape.clear();
+	}
+	
+	/**
+	 * Progress of each step is written to out, no output if out is 0 (default).
+	 */
+	void setLogger(std::ostream *out) {
+		log = out;
+	}
+	
+	void setVerbose(bool v) {
+		log = v ? &std::cout : 0;
+	}
+	
+	/**
+	 * Sets the maximal number of variables of a submap for the Submaps
+	 * solver. Takes effect at the next initialize().
+	 */
+	void setMaxSubmapSize(int size) {
+		maxSubmapSize = size > 0 ? size : 1;
+		shape.clear();
+	}
+	
+	/**
+	 * Caches the fill-reducing ordering and elimination tree of the QR and
+	 * Cholesky solvers in directory, one file per shape of the problem 
+	 * (see initialize()). If the same structure is initialized again, e.g. 
+	 * a fixed map loaded by another run, the symbolic analysis is read from 
+	 * the cache instead of being recomputed. An empty directory disables
+	 * the cache. Takes effect at the next initialize().
+	 */
+	void setOrderingCache(const std::string &directory) {
+		orderingCache = directory;
+	}
+	
+	const SubmapSolver* getSubmapSolver() const {
+		return submapSolver;
+	}
+	
+	/**
+	 * Options of the PCG solver: conjugate gradients stop when the residual 
+	 * is below tolerance times the right hand side, or after maxIterations.
+	 * The preconditioner is a spanning tree of the variables plus 
+	 * extraEdges times the number of variables of the strongest other 
+	 * couplings, see SubgraphSolver. Steps for which CG does not reach the
+	 * tolerance are solved by a sparse Cholesky factorization instead.
+	 * Takes effect at the next initialize().
+	 */
+	void setPCGOptions(double tolerance, int maxIterations=1000, double extraEdges=0.05) {
+		pcgTolerance = tolerance;
+		pcgMaxIterations = maxIterations > 0 ? maxIterations : 1;
+		subgraphExtraEdges = extraEdges;
+		shape.clear();
+	}
+	
+	/**
+	 * For the Cholesky solver: factors with more than budget bytes are 
+	 * stored in a scratch file in directory, of which about budget bytes
+	 * are kept in memory while factorizing, see OutOfCoreCholesky. Use this
+	 * if the factor does not fit into RAM. If the scratch file can not be 
+	 * created with room for the factor, it is factorized in memory.
+	 * An empty directory keeps all factors in memory (default). 
+	 * The candidates of speculative damping are always kept in memory.
+	 */
+	void setOutOfCore(const std::string &directory, long budget=0) {
+		outOfCoreDirectory = directory;
+		inCoreBudget = budget;
+	}
+	
+	const SubgraphSolver* getSubgraphSolver() const {
+		return subgraphSolver;
+	}
+	
+	/**
+	 * The Jacobian of the last step, with the damping below it for
+	 * Levenberg(-Marquardt), and the upper triangle of J^T J assembled
+	 * from it. 0 if the solver or algorithm does not use them.
+	 */
+	const cs* getJacobian() const {
+		return jacobian;
+	}
+	const cs* getNormalEquations() const {
+		return JtJ;
+	}
+	
 	const double * getCholCovariance() const {
 		return cholCovariance;
 	}
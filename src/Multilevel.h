@@ -0,0 +1,243 @@
+#ifndef MULTILEVEL_H_
+#define MULTILEVEL_H_
+
+#include "Estimator.h"
+#include "tools/PoseGraph.h"
+
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <ostream>
+
+namespace SLOM {
+
+/**
+ * Coarse-to-fine optimization of pose graphs.
+ *
+ * The graph is coarsened repeatedly by collapsing odometry chains: a pose
+ * with exactly two edges to two different poses is removed and its edges
+ * are combined into one relative pose measurement with the first order
+ * propagated covariance. In each level an independent set of such poses
+ * is removed, so chains halve from level to level.
+ *
+ * optimize() solves the coarsest level first, then places the removed
+ * poses of each finer level relative to their neighbor and refines the
+ * level with a few iterations. Large corrections of the drift are thus
+ * done on small problems.
+ *
+ * Poses and edges are as described for PoseGraphEdge.
+ */
+template<typename Pose_T>
+class Multilevel
+{
+public:
+	enum {DOF = Pose_T::DOF};
+	typedef RVWrapper<Pose_T> Pose;
+
+	Multilevel(Estimator::Solver solver=Estimator::Cholesky,
+			Estimator::Algorithm algorithm=Estimator::GaussNewton) :
+		solver(solver), algorithm(algorithm), log(0) {}
+
+	/**
+	 * Adds a pose with its initial value. Fixed poses are not optimized,
+	 * for Gauss-Newton at least one pose should be fixed.
+	 */
+	void addPose(int id, const Pose_T &pose, bool fixed=false){
+		poses[id] = pose;
+		if(fixed) fixedPoses.insert(id);
+	}
+
+	/**
+	 * Adds the edge (from, to, delta, information), see PoseGraphEdge.
+	 * Both poses must have been added before.
+	 */
+	void addEdge(int from, int to, const Pose_T &delta, const double *information){
+		if(levels.empty()) levels.resize(1);
+		levels[0].edges.push_back(Edge(from, to, delta, information));
+		levels.resize(1); // the hierarchy has to be built again
+	}
+
+	/**
+	 * Builds the coarser levels until hardly any chain can be collapsed
+	 * or maxLevels levels exist. Returns the number of levels.
+	 */
+	int buildLevels(int maxLevels=16);
+
+	int getNumLevels() const {
+		return levels.size();
+	}
+
+	/**
+	 * Solves the coarsest level with up to coarseIterations steps, then
+	 * each finer level with up to fineIterations steps. Builds the levels
+	 * first, if buildLevels() was not called. Returns why the
+	 * optimization of the finest level stopped.
+	 */
+	Estimator::StopReason optimize(int coarseIterations, int fineIterations,
+			const Estimator::Tolerances &tol=Estimator::Tolerances());
+
+	/**
+	 * The current value of all poses.
+	 */
+	const std::map<int, Pose_T>& getPoses() const {
+		return poses;
+	}
+
+	/**
+	 * Progress is written to out, no output if out is 0 (default).
+	 */
+	void setLogger(std::ostream *out) {
+		log = out;
+	}
+
+private:
+	typedef PoseGraphEdge<Pose_T> Edge;
+	typedef PoseGraphMeasurement<Pose_T> RelativePose;
+
+	/**
+	 * A pose removed from a level, it is placed at
+	 * poses[neighbor].local2World(relative).
+	 */
+	struct Removed {
+		int pose, neighbor;
+		Pose_T relative;
+	};
+
+	struct Level {
+		std::vector<Edge> edges;
+		std::vector<Removed> removed; // poses removed to get the next coarser level
+	};
+
+	/**
+	 * A coarser level is only built if it has at least 1/MIN_REDUCTION
+	 * fewer poses.
+	 */
+	enum {MIN_REDUCTION = 10};
+
+	std::map<int, Pose_T> poses;
+	std::set<int> fixedPoses;
+	std::vector<Level> levels;
+
+	Estimator::Solver solver;
+	Estimator::Algorithm algorithm;
+	std::ostream *log;
+
+	Estimator::StopReason solveLevel(int level, int maxIterations, const Estimator::Tolerances &tol);
+};
+
+
+template<typename Pose_T>
+int Multilevel<Pose_T>::buildLevels(int maxLevels){
+	if(levels.empty()) return 0;
+	levels.resize(1);
+	levels[0].removed.clear();
+	while((int)levels.size() < maxLevels){
+		Level &fine = levels.back();
+		std::map<int, std::vector<int> > incident;
+		for(size_t k=0; k<fine.edges.size(); k++){
+			incident[fine.edges[k].from].push_back(k);
+			incident[fine.edges[k].to].push_back(k);
+		}
+
+		Level coarse;
+		std::set<int> touched; // removed poses and their neighbors
+		std::vector<char> combined(fine.edges.size(), false);
+		for(std::map<int, std::vector<int> >::const_iterator it = incident.begin(); it != incident.end(); it++){
+			int v = it->first;
+			if(it->second.size() != 2 || fixedPoses.count(v) || touched.count(v)) continue;
+			const Edge &first = fine.edges[it->second[0]], &second = fine.edges[it->second[1]];
+			int a = first.from == v ? first.to : first.from;
+			int b = second.from == v ? second.to : second.from;
+			if(a == v || b == v || a == b) continue;
+
+			// orient the edges as a->v and v->b:
+			Edge toV, fromV, e;
+			if(first.from == a) toV = first;
+			else first.reverse(toV);
+			if(second.from == v) fromV = second;
+			else second.reverse(fromV);
+			Edge::compose(toV, fromV, e);
+			coarse.edges.push_back(e);
+			combined[it->second[0]] = combined[it->second[1]] = true;
+			touched.insert(v); touched.insert(a); touched.insert(b);
+
+			// place v relative to the neighbor with the more informative edge:
+			double traceA = 0, traceB = 0;
+			for(int k=0; k<DOF; k++){
+				traceA += first.information[k*DOF+k];
+				traceB += second.information[k*DOF+k];
+			}
+			Removed r;
+			r.pose = v;
+			r.neighbor = traceA >= traceB ? a : b;
+			r.relative = traceA >= traceB ? first.relativeFrom(a) : second.relativeFrom(b);
+			fine.removed.push_back(r);
+		}
+		if(fine.removed.size()*MIN_REDUCTION < incident.size()){
+			// not worth another level
+			fine.removed.clear();
+			break;
+		}
+		for(size_t k=0; k<fine.edges.size(); k++){
+			if(!combined[k]) coarse.edges.push_back(fine.edges[k]);
+		}
+		levels.push_back(coarse);
+	}
+	return levels.size();
+}
+
+template<typename Pose_T>
+Estimator::StopReason Multilevel<Pose_T>::solveLevel(int level, int maxIterations,
+		const Estimator::Tolerances &tol)
+{
+	const std::vector<Edge> &edges = levels[level].edges;
+	std::map<int, Pose*> vars;
+	std::deque<Pose> storage;
+	std::deque<RelativePose> measurements;
+	Estimator e(solver, algorithm);
+	for(size_t k=0; k<edges.size(); k++){
+		int ids[2] = {edges[k].from, edges[k].to};
+		for(int j=0; j<2; j++){
+			if(vars.count(ids[j])) continue;
+			storage.push_back(Pose(poses[ids[j]], !fixedPoses.count(ids[j])));
+			vars[ids[j]] = &storage.back();
+			e.insertRV(vars[ids[j]]);
+		}
+		measurements.push_back(RelativePose(*vars[ids[0]], *vars[ids[1]], edges[k]));
+		e.insertMeasurement(&measurements.back());
+	}
+	if(log){
+		*log << "Level " << level << ": " << vars.size() << " poses, "
+		     << edges.size() << " edges" << std::endl;
+	}
+	e.setLogger(log);
+	e.initialize();
+	Estimator::StopReason reason = e.optimize(maxIterations, tol);
+	for(typename std::map<int, Pose*>::const_iterator it = vars.begin(); it != vars.end(); it++){
+		poses[it->first] = **it->second;
+	}
+	return reason;
+}
+
+template<typename Pose_T>
+Estimator::StopReason Multilevel<Pose_T>::optimize(int coarseIterations, int fineIterations,
+		const Estimator::Tolerances &tol)
+{
+	if(levels.empty()) return Estimator::StepSize; // nothing to optimize
+	if(levels.size() == 1) buildLevels();
+	Estimator::StopReason reason = Estimator::MaxIterations;
+	for(int l=levels.size()-1; l>=0; l--){
+		// place the poses which are not in the coarser level:
+		const std::vector<Removed> &removed = levels[l].removed;
+		for(size_t k=0; k<removed.size(); k++){
+			poses[removed[k].pose] = poses[removed[k].neighbor].local2World(removed[k].relative);
+		}
+		reason = solveLevel(l, l == (int)levels.size()-1 ? coarseIterations : fineIterations, tol);
+	}
+	return reason;
+}
+
+}  // namespace SLOM
+
+#endif /*MULTILEVEL_H_*/
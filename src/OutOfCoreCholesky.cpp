@@ -0,0 +1,268 @@
+#include "OutOfCoreCholesky.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace SLOM {
+
+
+OutOfCoreCholesky::OutOfCoreCholesky(const std::string &directory) :
+	directory(directory), fd(-1), map(0), bytes(0), valid(false),
+	residentBytes(0), peakBytes(0)
+{
+	L.nzmax = L.m = L.n = 0;
+	L.p = L.i = 0;
+	L.x = 0;
+	L.nz = -1;
+	factor.L = &L;
+	factor.U = 0;
+	factor.pinv = 0;
+	factor.B = 0;
+}
+
+OutOfCoreCholesky::~OutOfCoreCholesky(){
+	unmapFile();
+}
+
+void OutOfCoreCholesky::unmapFile(){
+	if(map) munmap(map, bytes);
+	if(fd >= 0) close(fd);
+	map = 0;
+	fd = -1;
+	bytes = 0;
+	valid = false;
+}
+
+/**
+ * Maps a file for nnz values and row indices, the values first for alignment.
+ */
+/**
+ * Allocates the blocks of the first bytes of the file. ftruncate() alone
+ * leaves a sparse file, and a full disk would raise SIGBUS at the first
+ * write to the mapping instead of failing here.
+ */
+static bool reserve(int fd, long bytes){
+	int error = posix_fallocate(fd, 0, bytes);
+	if(error != EINVAL && error != EOPNOTSUPP) return error == 0;
+	// not supported by the file system, write zeros instead:
+	std::vector<char> zeros(1 << 16, 0);
+	for(long written = 0; written < bytes; ){
+		ssize_t w = write(fd, &zeros[0], std::min(long(zeros.size()), bytes - written));
+		if(w < 0 && errno == EINTR) continue;
+		if(w <= 0) return false;
+		written += w;
+	}
+	return true;
+}
+
+/**
+ * Creates a scratch file with room for nnz entries of L and maps it,
+ * returns false if the file can not be created or its space not
+ * reserved.
+ */
+bool OutOfCoreCholesky::mapFile(int nnz){
+	long need = std::max(1L, long(nnz)) * long(sizeof(double) + sizeof(int));
+	if(map && need == bytes) return true;
+	unmapFile();
+	std::string name = directory + "/slom-factor-XXXXXX";
+	std::vector<char> path(name.begin(), name.end());
+	path.push_back(0);
+	fd = mkstemp(&path[0]);
+	if(fd < 0) return false;
+	unlink(&path[0]);
+	if(!reserve(fd, need)){
+		unmapFile();
+		return false;
+	}
+	void *m = mmap(0, need, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(m == MAP_FAILED){
+		unmapFile();
+		return false;
+	}
+	map = m;
+	bytes = need;
+	L.x = static_cast<double*>(map);
+	L.i = reinterpret_cast<int*>(L.x + std::max(1, nnz));
+	return true;
+}
+
+/**
+ * Bytes of one entry of L in the file.
+ */
+static const long ENTRY_BYTES = sizeof(double) + sizeof(int);
+
+/**
+ * Writes the whole pages between begin and end back to the file and drops
+ * them from memory.
+ */
+static void dropPages(const void *begin, const void *end){
+	static const size_t page = sysconf(_SC_PAGESIZE);
+	size_t first = (reinterpret_cast<size_t>(begin) + page - 1) / page * page;
+	size_t last = reinterpret_cast<size_t>(end) / page * page;
+	if(first >= last) return;
+	void *start = reinterpret_cast<void*>(first);
+	msync(start, last - first, MS_SYNC);
+	madvise(start, last - first, MADV_DONTNEED);
+}
+
+/**
+ * Splits the columns into panels of at least window / PANELS bytes.
+ */
+void OutOfCoreCholesky::makePanels(long window){
+	int n = L.n;
+	long entries = std::max(1L, window / PANELS / ENTRY_BYTES);
+	panelStart.clear();
+	panelOf.resize(n);
+	for(int j=0; j<n; j++){
+		if(panelStart.empty() || Lp[j] - Lp[panelStart.back()] >= entries) panelStart.push_back(j);
+		panelOf[j] = panelStart.size() - 1;
+	}
+	int panels = panelStart.size();
+	panelStart.push_back(n);
+	pending.resize(panels);
+	for(int k=0; k<panels; k++) pending[k] = panelStart[k+1] - panelStart[k];
+	resident.assign(panels, false);
+	residentBytes = peakBytes = 0;
+}
+
+/**
+ * Column is written or read, its panel is in memory.
+ */
+void OutOfCoreCholesky::touch(int column){
+	int panel = panelOf[column];
+	if(resident[panel]) return;
+	resident[panel] = true;
+	residentBytes += (Lp[panelStart[panel+1]] - Lp[panelStart[panel]]) * ENTRY_BYTES;
+}
+
+/**
+ * Column will not be read anymore, its panel is dropped with its last column.
+ */
+void OutOfCoreCholesky::finish(int column){
+	int panel = panelOf[column];
+	if(--pending[panel] == 0) dropPanel(panel);
+}
+
+void OutOfCoreCholesky::dropPanel(int panel){
+	if(!resident[panel]) return;
+	resident[panel] = false;
+	int begin = Lp[panelStart[panel]], end = Lp[panelStart[panel+1]];
+	residentBytes -= (end - begin) * ENTRY_BYTES;
+	dropPages(L.x + begin, L.x + end);
+	dropPages(L.i + begin, L.i + end);
+}
+
+csn* OutOfCoreCholesky::factorize(const cs *A, const css *S, long budget){
+	valid = false;
+	int n = A->n;
+	const int *cp = S->cp, *parent = S->parent;
+	if(!mapFile(cp[n])) return 0;
+	Lp.assign(cp, cp+n+1);
+	L.nzmax = cp[n];
+	L.m = L.n = n;
+	L.p = &Lp[0];
+	int *Li = L.i;
+	double *Lx = L.x;
+	long window = std::max(budget, long(MIN_WINDOW));
+	makePanels(window);
+
+	cs *C = cs_symperm(A, S->pinv, 1);  // upper triangle of PAP'
+	cs *R = C ? cs_transpose(C, 1) : 0; // column j is PAP'(j:n, j)
+	std::vector<int> s(n), w(n, 0);     // stack and marks of cs_ereach()
+	std::vector<int> next(n);           // entry of each column in the current row
+	std::vector<int> lastRow(n, -1), link(n, -1); // lists of the columns by their last row
+	std::vector<int> mark(n, -1), rows; // rows of column j below the diagonal
+	std::vector<double> x(n, 0);
+	bool ok = R != 0;
+	for(int j=0; j<n && ok; j++){
+		rows.clear();
+		for(int p=R->p[j]; p<R->p[j+1]; p++){
+			int i = R->i[p];
+			x[i] = R->x[p];
+			if(i > j && mark[i] != j){
+				mark[i] = j;
+				rows.push_back(i);
+			}
+		}
+		// subtract the columns with a non-zero in row j, from the elimination tree:
+		for(int top = cs_ereach(C, j, parent, &s[0], &w[0]); top<n; top++){
+			int k = s[top];
+			touch(k);
+			int p = next[k]++;
+			double ljk = Lx[p];
+			x[j] -= ljk * ljk;
+			for(p++; p<Lp[k+1]; p++){
+				int i = Li[p];
+				x[i] -= Lx[p] * ljk;
+				if(mark[i] != j){
+					mark[i] = j;
+					rows.push_back(i);
+				}
+			}
+		}
+		double d = x[j];
+		x[j] = 0;
+		if(!(d > 0) || int(rows.size()) != Lp[j+1] - Lp[j] - 1){
+			ok = false;
+			break;
+		}
+		// append column j:
+		std::sort(rows.begin(), rows.end());
+		touch(j);
+		double ljj = std::sqrt(d);
+		int p = Lp[j];
+		Li[p] = j;
+		Lx[p] = ljj;
+		for(size_t e=0; e<rows.size(); e++){
+			int i = rows[e];
+			Li[++p] = i;
+			Lx[p] = x[i] / ljj;
+			x[i] = 0;
+		}
+		next[j] = Lp[j] + 1;
+		if(rows.empty()){
+			finish(j);
+		} else {
+			link[j] = lastRow[rows.back()];
+			lastRow[rows.back()] = j;
+		}
+		for(int k = lastRow[j]; k != -1; k = link[k]) finish(k);
+
+		peakBytes = std::max(peakBytes, residentBytes);
+		if(residentBytes > window){
+			for(int panel=0; panel<panelOf[j]; panel++) dropPanel(panel);
+		}
+	}
+	cs_spfree(R);
+	cs_spfree(C);
+	valid = ok;
+	return getFactor();
+}
+
+void OutOfCoreCholesky::postorder(css *S, int n){
+	int *post = cs_post(S->parent, n);
+	if(!post) return;
+	std::vector<int> inverse(n);
+	for(int k=0; k<n; k++) inverse[post[k]] = k;
+	std::vector<int> parent(S->parent, S->parent+n), cp(S->cp, S->cp+n+1);
+	for(int k=0; k<n; k++){
+		int j = post[k];
+		S->parent[k] = parent[j] < 0 ? -1 : inverse[parent[j]];
+		S->cp[k+1] = S->cp[k] + cp[j+1] - cp[j];
+	}
+	if(!S->pinv){
+		S->pinv = static_cast<int*>(cs_malloc(n, sizeof(int)));
+		for(int i=0; i<n; i++) S->pinv[i] = i;
+	}
+	for(int i=0; i<n; i++) S->pinv[i] = inverse[S->pinv[i]];
+	cs_free(post);
+}
+
+
+}  // namespace SLOM
@@ -0,0 +1,117 @@
+#ifndef OUTOFCORECHOLESKY_H_
+#define OUTOFCORECHOLESKY_H_
+
+#include <string>
+#include <vector>
+
+#include <cs.h>
+
+namespace SLOM {
+
+/**
+ * Cholesky factorization of problems whose factor does not fit into RAM.
+ *
+ * The row indices and values of L are stored in a scratch file, which is
+ * mapped into memory. Besides a window of the file, only the column
+ * pointers, a copy of the permuted matrix and O(n) work vectors are kept
+ * in memory. The factorization is left-looking: column j of L is computed
+ * from column j of A and the columns of L with a non-zero in row j, which
+ * all lie in the subtree of j in the elimination tree, and is then appended
+ * to the file. With the columns in a postorder of the tree (see
+ * postorder()), the file is written sequentially and column j only reads
+ * the tails of columns in the contiguous range of its subtree.
+ *
+ * The file is divided into panels of consecutive columns. A panel whose
+ * columns are not read anymore is written back and dropped from memory.
+ * If the panels in memory exceed the budget, all of them are dropped and
+ * paged in again from the file when they are read.
+ * The file is unlinked right after it is created, so it disappears when
+ * it is closed, also after a crash. Its space is allocated up front, so a
+ * full disk fails factorize() rather than a write to the mapping.
+ */
+class OutOfCoreCholesky
+{
+public:
+	/**
+	 * The scratch file is created in directory.
+	 */
+	explicit OutOfCoreCholesky(const std::string &directory);
+	~OutOfCoreCholesky();
+
+	/**
+	 * Numeric factorization like cs_chol(A, S), keeping about budget bytes
+	 * of the factor in memory, at least MIN_WINDOW. The file is reused
+	 * while the number of non-zeros stays the same. Returns the factor,
+	 * which belongs to this object and is valid until the next
+	 * factorize(), or 0 if A is not positive definite or the file could
+	 * not be created with room for the factor.
+	 */
+	csn* factorize(const cs *A, const css *S, long budget);
+
+	/**
+	 * The factor of the last successful factorize(), 0 if none.
+	 */
+	csn* getFactor() { return valid ? &factor : 0; }
+
+	/**
+	 * N is the factor of this object, it must not be freed by cs_nfree().
+	 */
+	bool owns(const csn *N) const { return N && N == &factor; }
+
+	/**
+	 * Size of the scratch file.
+	 */
+	long getFileBytes() const { return bytes; }
+
+	/**
+	 * Largest size of the panels in memory after a column of the last
+	 * factorize().
+	 */
+	long getPeakBytes() const { return peakBytes; }
+
+	/**
+	 * Relabels the columns of the symbolic analysis S of an n x n matrix
+	 * in a postorder of its elimination tree. The fill stays the same.
+	 */
+	static void postorder(css *S, int n);
+
+	enum {
+		MIN_WINDOW = 1 << 20, // bytes of the factor kept in memory at least
+		PANELS = 16           // panels per window
+	};
+
+private:
+	std::string directory;
+	int fd;
+	void *map;
+	long bytes;
+
+	std::vector<int> Lp;
+	cs L;
+	csn factor;
+	bool valid;
+
+	// panels of the factorization:
+	std::vector<int> panelStart; // first column of each panel, and n
+	std::vector<int> panelOf;    // panel of each column
+	std::vector<int> pending;    // columns of each panel which are still read
+	std::vector<char> resident;  // the panel was written or read since it was dropped
+	long residentBytes;
+	long peakBytes;
+
+	bool mapFile(int nnz);
+	void unmapFile();
+
+	void makePanels(long window);
+	void touch(int column);
+	void finish(int column);
+	void dropPanel(int panel);
+
+	// not copyable:
+	OutOfCoreCholesky(const OutOfCoreCholesky&);
+	OutOfCoreCholesky& operator=(const OutOfCoreCholesky&);
+};
+
+}  // namespace SLOM
+
+#endif /*OUTOFCORECHOLESKY_H_*/
@@ -0,0 +1,347 @@
+#ifndef SPARSIFIER_H_
+#define SPARSIFIER_H_
+
+#include "tools/PoseGraph.h"
+
+#include <map>
+#include <set>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+namespace SLOM {
+
+/**
+ * Information preserving sparsification of pose graphs.
+ *
+ * A pose graph of a long-term run grows with the trajectory, also if the
+ * robot hardly moves. sparsify() removes redundant poses, i.e. poses
+ * close to one of their neighbors which are connected to only a few other
+ * poses, and replaces their edges by a sparse approximation of the
+ * information they induce between the remaining neighbors:
+ *
+ * The edges of the removed pose are solved alone and linearized at their
+ * optimum, and the pose is marginalized out, which couples all its
+ * neighbors densely. For each pair of neighbors the marginal information about
+ * their relative pose is computed, and the pairs are connected by a
+ * maximum spanning tree weighted by its log-determinant, like the
+ * Chow-Liu tree of the dense distribution. Each tree edge becomes a
+ * relative pose edge with the relative pose at that optimum and the
+ * marginal information. For a pose with two neighbors this is the first order
+ * composition of its two edges, without any approximation.
+ *
+ * Poses and edges are as described for PoseGraphEdge.
+ */
+template<typename Pose_T>
+class Sparsifier
+{
+public:
+	enum {DOF = Pose_T::DOF};
+
+	typedef PoseGraphEdge<Pose_T> Edge;
+
+	/**
+	 * Adds a pose with its current estimate. Fixed poses are never removed.
+	 */
+	void addPose(int id, const Pose_T &pose, bool fixed=false){
+		poses[id] = pose;
+		if(fixed) fixedPoses.insert(id);
+	}
+
+	/**
+	 * Adds the edge (from, to, delta, information), see PoseGraphEdge.
+	 * Both poses must have been added before.
+	 */
+	void addEdge(int from, int to, const Pose_T &delta, const double *information){
+		edges.push_back(Edge(from, to, delta, information));
+	}
+
+	/**
+	 * Removes, in the order of their ids, each pose which is closer than
+	 * minMotion to one of its neighbors and connected to at most
+	 * maxNeighbors other poses. Poses with more neighbors close loops and
+	 * are kept, this also bounds the size of the dense marginals.
+	 * The motion is the norm of the relative pose in its tangent space,
+	 * i.e. translation and rotation are mixed.
+	 * Returns the number of removed poses.
+	 */
+	int sparsify(double minMotion, int maxNeighbors=4);
+
+	/**
+	 * The remaining poses.
+	 */
+	const std::map<int, Pose_T>& getPoses() const {
+		return poses;
+	}
+
+	/**
+	 * The edges between the remaining poses.
+	 */
+	const std::vector<Edge>& getEdges() const {
+		return edges;
+	}
+
+private:
+	std::map<int, Pose_T> poses;
+	std::set<int> fixedPoses;
+	std::vector<Edge> edges;
+
+	/**
+	 * Gauss-Newton iterations and step norm to solve the edges of a removed
+	 * pose before it is marginalized.
+	 */
+	enum {MAX_ITERATIONS = 10};
+	static const double STEP_TOLERANCE;
+
+	void linearize(const std::vector<int> &incident, const std::vector<int> &ids,
+			const std::vector<Pose_T> &local, std::vector<double> &H, std::vector<double> &g) const;
+	void marginalize(int v, const std::vector<int> &incident, const std::vector<int> &neighbors,
+			std::vector<Edge> &result) const;
+};
+
+
+template<typename Pose_T>
+const double Sparsifier<Pose_T>::STEP_TOLERANCE = 1e-9;
+
+/**
+ * Information H and gradient g of the incident edges, linearized at local
+ * and weighted like the Estimator whitens them, see PoseGraphEdge.
+ * ids[0] is the removed pose, ids[1..k] are its neighbors, local holds
+ * their values.
+ */
+template<typename Pose_T>
+void Sparsifier<Pose_T>::linearize(const std::vector<int> &incident, const std::vector<int> &ids,
+		const std::vector<Pose_T> &local, std::vector<double> &H, std::vector<double> &g) const
+{
+	int n = ids.size()*DOF;
+	H.assign(n*n, 0.0);
+	g.assign(n, 0.0);
+	for(size_t e=0; e<incident.size(); e++){
+		const Edge &edge = edges[incident[e]];
+		int blocks[2];
+		blocks[0] = std::find(ids.begin(), ids.end(), edge.from) - ids.begin();
+		blocks[1] = std::find(ids.begin(), ids.end(), edge.to) - ids.begin();
+		const Pose_T &from = local[blocks[0]], &to = local[blocks[1]];
+		double J[2][DOF*DOF], res[DOF], W[DOF*DOF];
+		PoseGraph::jacobian(PoseGraph::LocalFrom<Pose_T>(to), from, edge.delta, J[0]);
+		PoseGraph::jacobian(PoseGraph::LocalTo<Pose_T>(from), to, edge.delta, J[1]);
+		from.world2Local(to).sub(res, edge.delta);
+		PoseGraph::weight<DOF>(edge.information, W);
+		// H += J^T W J, g += J^T W res
+		for(int a=0; a<2; a++){
+			for(int i=0; i<DOF; i++){
+				for(int r=0; r<DOF; r++){
+					for(int c=0; c<DOF; c++){
+						g[blocks[a]*DOF+i] += J[a][r*DOF+i] * W[r*DOF+c] * res[c];
+					}
+				}
+			}
+			for(int b=0; b<2; b++){
+				for(int i=0; i<DOF; i++){
+					for(int j=0; j<DOF; j++){
+						double s = 0;
+						for(int r=0; r<DOF; r++){
+							for(int c=0; c<DOF; c++){
+								s += J[a][r*DOF+i] * W[r*DOF+c] * J[b][c*DOF+j];
+							}
+						}
+						H[(blocks[a]*DOF+i)*n + blocks[b]*DOF+j] += s;
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Marginalizes pose v with the given incident edges out and appends the
+ * tree of edges between its neighbors to result.
+ */
+template<typename Pose_T>
+void Sparsifier<Pose_T>::marginalize(int v, const std::vector<int> &incident,
+		const std::vector<int> &neighbors, std::vector<Edge> &result) const
+{
+	int k = neighbors.size();
+	if(k < 2) return; // a leaf does not constrain its neighbor
+	std::vector<int> ids(1, v);
+	ids.insert(ids.end(), neighbors.begin(), neighbors.end());
+	std::vector<Pose_T> local;
+	for(size_t a=0; a<ids.size(); a++) local.push_back(poses.find(ids[a])->second);
+
+	// solve the incident edges alone, with the first neighbor fixed, so the
+	// tree edges are exact at their optimum:
+	int n = (k+1)*DOF;
+	std::vector<double> H, g;
+	for(int it=0; it<MAX_ITERATIONS; it++){
+		linearize(incident, ids, local, H, g);
+		int r = n - DOF;
+		std::vector<double> A(r*r);
+		for(int i=0; i<r; i++){
+			int gi = i < DOF ? i : i + DOF;
+			for(int j=0; j<r; j++){
+				A[i*r+j] = H[gi*n + (j < DOF ? j : j + DOF)];
+			}
+		}
+		if(!PoseGraph::invert(&A[0], r)) return;
+		double norm = 0;
+		for(int b=0; b<=k; b++){
+			if(b == 1) continue;
+			double step[DOF];
+			for(int i=0; i<DOF; i++){
+				int row = (b == 0 ? 0 : b-1)*DOF + i;
+				step[i] = 0;
+				for(int j=0; j<r; j++){
+					step[i] -= A[row*r+j] * g[j < DOF ? j : j + DOF];
+				}
+				norm += step[i]*step[i];
+			}
+			local[b].add(step, 1);
+		}
+		if(norm < STEP_TOLERANCE*STEP_TOLERANCE) break;
+	}
+	linearize(incident, ids, local, H, g);
+
+	// Schur complement of v:
+	std::vector<double> Hvv(DOF*DOF);
+	for(int i=0; i<DOF; i++){
+		std::copy(&H[i*n], &H[i*n] + DOF, &Hvv[i*DOF]);
+	}
+	if(!PoseGraph::invert(&Hvv[0], DOF)) return;
+	int m = k*DOF;
+	std::vector<double> marginal(m*m);
+	for(int i=0; i<m; i++){
+		for(int j=0; j<m; j++){
+			double s = H[(DOF+i)*n + DOF+j];
+			for(int a=0; a<DOF; a++){
+				for(int b=0; b<DOF; b++){
+					s -= H[(DOF+i)*n + a] * Hvv[a*DOF+b] * H[b*n + DOF+j];
+				}
+			}
+			marginal[i*m+j] = s;
+		}
+	}
+
+	// marginal weight of the relative pose of each pair:
+	typedef std::pair<double, std::pair<int, int> > Candidate;
+	std::vector<Candidate> candidates;
+	std::map<std::pair<int, int>, std::vector<double> > weights;
+	for(int a=0; a<k; a++){
+		// covariance of the other neighbors given neighbor a:
+		std::vector<int> rest;
+		for(int b=0; b<k; b++) if(b != a) rest.push_back(b);
+		int r = rest.size()*DOF;
+		std::vector<double> cov(r*r);
+		for(int i=0; i<r; i++){
+			for(int j=0; j<r; j++){
+				cov[i*r+j] = marginal[(rest[i/DOF]*DOF + i%DOF)*m + rest[j/DOF]*DOF + j%DOF];
+			}
+		}
+		if(!PoseGraph::invert(&cov[0], r)) return;
+		for(size_t t=0; t<rest.size(); t++){
+			int b = rest[t];
+			if(b < a) continue;
+			const Pose_T &from = local[1+a], &to = local[1+b];
+			double J[DOF*DOF];
+			PoseGraph::jacobian(PoseGraph::LocalTo<Pose_T>(from), to, from.world2Local(to), J);
+			// relative covariance J cov_bb J^T:
+			std::vector<double> rel(DOF*DOF);
+			for(int i=0; i<DOF; i++){
+				for(int j=0; j<DOF; j++){
+					double s = 0;
+					for(int c=0; c<DOF; c++){
+						for(int d=0; d<DOF; d++){
+							s += J[i*DOF+c] * cov[(t*DOF+c)*r + t*DOF+d] * J[j*DOF+d];
+						}
+					}
+					rel[i*DOF+j] = s;
+				}
+			}
+			if(!PoseGraph::invert(&rel[0], DOF)) continue;
+			candidates.push_back(Candidate(PoseGraph::logDet<DOF>(&rel[0]), std::make_pair(a, b)));
+			weights[std::make_pair(a, b)] = rel;
+		}
+	}
+
+	// Kruskal's maximum spanning tree:
+	std::sort(candidates.begin(), candidates.end(), std::greater<Candidate>());
+	std::vector<int> component(k);
+	for(int a=0; a<k; a++) component[a] = a;
+	for(size_t c=0; c<candidates.size(); c++){
+		int a = candidates[c].second.first, b = candidates[c].second.second;
+		int ca = component[a], cb = component[b];
+		if(ca == cb) continue;
+		std::replace(component.begin(), component.end(), cb, ca);
+		Edge e;
+		e.from = neighbors[a];
+		e.to = neighbors[b];
+		e.delta = local[1+a].world2Local(local[1+b]);
+		PoseGraph::whitening<DOF>(&weights[candidates[c].second][0], e.information);
+		result.push_back(e);
+	}
+}
+
+template<typename Pose_T>
+int Sparsifier<Pose_T>::sparsify(double minMotion, int maxNeighbors){
+	std::map<int, std::set<int> > incident;
+	for(size_t k=0; k<edges.size(); k++){
+		incident[edges[k].from].insert(k);
+		incident[edges[k].to].insert(k);
+	}
+	std::vector<char> removedEdges(edges.size(), false);
+	int removed = 0;
+	for(typename std::map<int, Pose_T>::iterator it = poses.begin(); it != poses.end(); ){
+		int v = it->first;
+		const std::set<int> &inc = incident[v];
+		std::vector<int> neighbors;
+		double motion = minMotion;
+		for(std::set<int>::const_iterator e = inc.begin(); e != inc.end(); e++){
+			int other = edges[*e].from == v ? edges[*e].to : edges[*e].from;
+			if(other == v || std::find(neighbors.begin(), neighbors.end(), other) != neighbors.end()) continue;
+			neighbors.push_back(other);
+			double diff[DOF];
+			poses[other].world2Local(it->second).sub(diff, Pose_T());
+			double norm = 0;
+			for(int d=0; d<DOF; d++) norm += diff[d]*diff[d];
+			motion = std::min(motion, std::sqrt(norm));
+		}
+		if(fixedPoses.count(v) || motion >= minMotion || (int)neighbors.size() > maxNeighbors){
+			++it;
+			continue;
+		}
+
+		std::vector<Edge> tree;
+		std::vector<int> incidentEdges(inc.begin(), inc.end());
+		marginalize(v, incidentEdges, neighbors, tree);
+		if(neighbors.size() >= 2 && tree.size() + 1 != neighbors.size()){
+			++it; // the marginal was not positive definite
+			continue;
+		}
+		for(size_t e=0; e<incidentEdges.size(); e++){
+			const Edge &edge = edges[incidentEdges[e]];
+			incident[edge.from].erase(incidentEdges[e]);
+			incident[edge.to].erase(incidentEdges[e]);
+			removedEdges[incidentEdges[e]] = true;
+		}
+		for(size_t e=0; e<tree.size(); e++){
+			edges.push_back(tree[e]);
+			removedEdges.push_back(false);
+			incident[tree[e].from].insert(edges.size()-1);
+			incident[tree[e].to].insert(edges.size()-1);
+		}
+		incident.erase(v);
+		poses.erase(it++);
+		removed++;
+	}
+
+	std::vector<Edge> remaining;
+	for(size_t k=0; k<edges.size(); k++){
+		if(!removedEdges[k]) remaining.push_back(edges[k]);
+	}
+	edges.swap(remaining);
+	return removed;
+}
+
+}  // namespace SLOM
+
+#endif /*SPARSIFIER_H_*/
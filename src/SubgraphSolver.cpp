@@ -0,0 +1,196 @@
+#include "SubgraphSolver.h"
+
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <utility>
+#include <map>
+#include <set>
+#include <cmath>
+#include <cassert>
+
+namespace SLOM {
+
+
+/**
+ * Root of the set of v in the union-find forest parent, with path halving.
+ */
+static int findRoot(std::vector<int> &parent, int v){
+	while(parent[v] != v){
+		parent[v] = parent[parent[v]];
+		v = parent[v];
+	}
+	return v;
+}
+
+/**
+ * $y = A x$ for the symmetric matrix A given by its upper triangle.
+ */
+static void symmetricMultiply(const cs *A, const double *x, double *y){
+	std::fill_n(y, A->n, 0.0);
+	for(int j=0; j<A->n; j++){
+		for(int p=A->p[j]; p<A->p[j+1]; p++){
+			int i = A->i[p];
+			y[i] += A->x[p] * x[j];
+			if(i != j) y[j] += A->x[p] * x[i];
+		}
+	}
+}
+
+
+SubgraphSolver::SubgraphSolver(const cs *JtJ, const std::vector<int> &columns, double extraEdges,
+		double tolerance, int maxIterations) :
+	n(JtJ->n), varOf(JtJ->n), extraEdges(extraEdges), tolerance(tolerance), maxIterations(maxIterations),
+	iterations(0), residual(0), numEdges(0), S(0), symbolic(0), numeric(0)
+{
+	int numVars = columns.size() - 1;
+	assert(columns[numVars] == n);
+	for(int v=0; v<numVars; v++){
+		std::fill(varOf.begin() + columns[v], varOf.begin() + columns[v+1], v);
+	}
+	r.resize(n);
+	z.resize(n);
+	p.resize(n);
+	q.resize(n);
+	w.resize(n);
+}
+
+SubgraphSolver::~SubgraphSolver(){
+	cs_spfree(S);
+	cs_sfree(symbolic);
+	cs_nfree(numeric);
+}
+
+
+/**
+ * Chooses the subgraph from the values of JtJ and sets up S.
+ */
+void SubgraphSolver::selectSubgraph(const cs *JtJ){
+	int numVars = varOf.empty() ? 0 : varOf.back() + 1;
+	// squared Frobenius norms of the blocks:
+	std::vector<double> diagonal(numVars, 0);
+	std::map<std::pair<int, int>, double> blocks;
+	for(int j=0; j<n; j++){
+		for(int k=JtJ->p[j]; k<JtJ->p[j+1]; k++){
+			int a = varOf[JtJ->i[k]], b = varOf[j];
+			double x2 = JtJ->x[k] * JtJ->x[k];
+			if(a == b) diagonal[a] += x2;
+			else blocks[std::make_pair(a, b)] += x2;
+		}
+	}
+	// coupling relative to the diagonal blocks, strongest first:
+	typedef std::pair<double, std::pair<int, int> > Edge;
+	std::vector<Edge> edges;
+	edges.reserve(blocks.size());
+	for(std::map<std::pair<int, int>, double>::const_iterator b = blocks.begin(); b != blocks.end(); b++){
+		double scale = std::sqrt(diagonal[b->first.first] * diagonal[b->first.second]);
+		edges.push_back(Edge(scale > 0 ? std::sqrt(b->second / scale) : 0, b->first));
+	}
+	std::sort(edges.begin(), edges.end(), std::greater<Edge>());
+
+	// Kruskal's maximum spanning forest, then the strongest other edges:
+	std::vector<int> parent(numVars);
+	for(int v=0; v<numVars; v++) parent[v] = v;
+	std::set<std::pair<int, int> > selected;
+	std::vector<std::pair<int, int> > others;
+	for(size_t e=0; e<edges.size(); e++){
+		int a = findRoot(parent, edges[e].second.first), b = findRoot(parent, edges[e].second.second);
+		if(a != b){
+			parent[a] = b;
+			selected.insert(edges[e].second);
+		} else {
+			others.push_back(edges[e].second);
+		}
+	}
+	size_t extra = std::min(others.size(), size_t(std::max(0.0, extraEdges * numVars)));
+	selected.insert(others.begin(), others.begin() + extra);
+	numEdges = selected.size();
+
+	// the entries of JtJ in the diagonal blocks and the selected blocks:
+	int nz = 0;
+	for(int j=0; j<n; j++){
+		for(int k=JtJ->p[j]; k<JtJ->p[j+1]; k++){
+			int a = varOf[JtJ->i[k]], b = varOf[j];
+			if(a == b || selected.count(std::make_pair(a, b))) nz++;
+		}
+	}
+	S = cs_spalloc(n, n, nz, true, false);
+	int *cIdx = S->p, *rIdx = S->i;
+	*cIdx = 0;
+	for(int j=0; j<n; j++){
+		for(int k=JtJ->p[j]; k<JtJ->p[j+1]; k++){
+			int a = varOf[JtJ->i[k]], b = varOf[j];
+			if(a == b || selected.count(std::make_pair(a, b))){
+				*rIdx++ = JtJ->i[k];
+				Smap.push_back(k);
+			}
+		}
+		*++cIdx = rIdx - S->i;
+	}
+	symbolic = cs_schol(1, S);
+	assert(symbolic);
+}
+
+/**
+ * out = $M^{-1}$ in with the factorized subgraph, or with the diagonal of
+ * JtJ if the subgraph is not positive definite.
+ */
+void SubgraphSolver::precondition(const cs *JtJ, const double *in, double *out){
+	if(numeric){
+		cs_ipvec(symbolic->pinv, in, &w[0], n);
+		cs_lsolve(numeric->L, &w[0]);
+		cs_ltsolve(numeric->L, &w[0]);
+		cs_pvec(symbolic->pinv, &w[0], out, n);
+	} else {
+		for(int j=0; j<n; j++){
+			double d = JtJ->x[JtJ->p[j+1]-1]; // the diagonal is the last entry of a column
+			out[j] = d > 0 ? in[j] / d : in[j];
+		}
+	}
+}
+
+bool SubgraphSolver::solve(const cs *JtJ, double *b){
+	assert(JtJ->n == n);
+	if(!S) selectSubgraph(JtJ);
+	for(size_t e=0; e<Smap.size(); e++){
+		S->x[e] = JtJ->x[Smap[e]];
+	}
+	cs_nfree(numeric);
+	numeric = cs_chol(S, symbolic);
+
+	// CG from x = 0, x is stored in b:
+	std::copy(b, b+n, r.begin());
+	std::fill(b, b+n, 0);
+	double norm2 = std::inner_product(r.begin(), r.end(), r.begin(), 0.0);
+	double limit = tolerance * tolerance * norm2;
+	precondition(JtJ, &r[0], &z[0]);
+	p = z;
+	double rz = std::inner_product(r.begin(), r.end(), z.begin(), 0.0);
+	for(iterations = 0; ; iterations++){
+		double rr = std::inner_product(r.begin(), r.end(), r.begin(), 0.0);
+		residual = norm2 > 0 ? std::sqrt(rr / norm2) : 0;
+		if(rr <= limit) return true;
+		if(iterations == maxIterations) return false;
+		symmetricMultiply(JtJ, &p[0], &q[0]);
+		double pq = std::inner_product(p.begin(), p.end(), q.begin(), 0.0);
+		if(!(pq > 0)) return false;
+		double alpha = rz / pq;
+		for(int k=0; k<n; k++){
+			b[k] += alpha * p[k];
+			r[k] -= alpha * q[k];
+		}
+		precondition(JtJ, &r[0], &z[0]);
+		double rzNew = std::inner_product(r.begin(), r.end(), z.begin(), 0.0);
+		double beta = rzNew / rz;
+		rz = rzNew;
+		for(int k=0; k<n; k++) p[k] = z[k] + beta * p[k];
+	}
+}
+
+
+long SubgraphSolver::getFactorNonZeros() const{
+	return numeric ? numeric->L->p[n] : 0;
+}
+
+
+}  // namespace SLOM
@@ -0,0 +1,94 @@
+#ifndef SUBGRAPHSOLVER_H_
+#define SUBGRAPHSOLVER_H_
+
+#include <vector>
+
+#include <cs.h>
+
+namespace SLOM {
+
+/**
+ * Solves the normal equations $J^T J x = b$ by conjugate gradients,
+ * preconditioned with a subgraph of the variable graph.
+ *
+ * At the first solve the variables are connected by a maximum spanning
+ * tree, weighted by the coupling of two variables relative to their
+ * diagonal blocks, and the strongest remaining couplings (the loop
+ * closures) are added. The preconditioner consists of all diagonal blocks
+ * of JtJ and the off-diagonal blocks of the subgraph. A tree has no fill-in,
+ * so factorizing it takes linear time, the extra couplings add some fill.
+ * The subgraph is kept, each solve only factorizes its new values.
+ */
+class SubgraphSolver
+{
+public:
+	/**
+	 * JtJ is the upper triangle of the normal equations, only its
+	 * structure is used. columns[v] is the first column of variable v and
+	 * columns[numVars] == JtJ->n. extraEdges times the number of variables
+	 * couplings are added to the spanning tree.
+	 * CG stops when the residual is below tolerance times b, or after
+	 * maxIterations.
+	 */
+	SubgraphSolver(const cs *JtJ, const std::vector<int> &columns, double extraEdges,
+			double tolerance, int maxIterations);
+	~SubgraphSolver();
+
+	/**
+	 * Solves JtJ x = b, b is overwritten by x. JtJ must have the
+	 * structure passed to the constructor.
+	 * Returns false if JtJ is not positive definite or CG did not reach
+	 * the tolerance within maxIterations, b holds the last iterate then.
+	 */
+	bool solve(const cs *JtJ, double *b);
+
+	/**
+	 * CG iterations of the last solve().
+	 */
+	int getIterations() const { return iterations; }
+
+	/**
+	 * Residual of the last solve() relative to b.
+	 */
+	double getResidual() const { return residual; }
+
+	/**
+	 * Number of pairs of variables coupled in the preconditioner.
+	 */
+	int getNumEdges() const { return numEdges; }
+
+	/**
+	 * Non-zeros of the factor of the preconditioner of the last solve(),
+	 * 0 if it was not positive definite and the diagonal was used instead.
+	 */
+	long getFactorNonZeros() const;
+
+private:
+	int n;                 // number of columns
+	std::vector<int> varOf; // variable of each column
+	double extraEdges;
+	double tolerance;
+	int maxIterations;
+	int iterations;
+	double residual;
+	int numEdges;
+
+	cs *S;                  // upper triangle of the preconditioner
+	std::vector<int> Smap;  // position in JtJ->x of each entry of S
+	css *symbolic;
+	csn *numeric;
+
+	// workspace:
+	std::vector<double> r, z, p, q, w;
+
+	void selectSubgraph(const cs *JtJ);
+	void precondition(const cs *JtJ, const double *in, double *out);
+
+	// not copyable:
+	SubgraphSolver(const SubgraphSolver&);
+	SubgraphSolver& operator=(const SubgraphSolver&);
+};
+
+}  // namespace SLOM
+
+#endif /*SUBGRAPHSOLVER_H_*/
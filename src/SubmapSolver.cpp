@@ -0,0 +1,418 @@
+#include "SubmapSolver.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cassert>
+
+namespace SLOM {
+
+
+/**
+ * Breadth first search from start over the variables owned by id.
+ * Sets level and the visited variables in order, returns the number of levels.
+ */
+static int bfs(int start, int id, const std::vector<std::vector<int> > &adjacency,
+		const std::vector<int> &owner, std::vector<int> &level, std::vector<int> &order)
+{
+	order.clear();
+	order.push_back(start);
+	level[start] = 0;
+	for(size_t q=0; q<order.size(); q++){
+		int v = order[q];
+		for(size_t a=0; a<adjacency[v].size(); a++){
+			int u = adjacency[v][a];
+			if(owner[u] == id && level[u] < 0){
+				level[u] = level[v] + 1;
+				order.push_back(u);
+			}
+		}
+	}
+	return level[order.back()] + 1;
+}
+
+static void resetLevels(const std::vector<int> &vars, std::vector<int> &level){
+	for(size_t k=0; k<vars.size(); k++) level[vars[k]] = -1;
+}
+
+
+/**
+ * Nested dissection of the variable graph.
+ * Sets of variables are split at the middle level of a breadth first search
+ * from a pseudo-peripheral variable, the variables of the middle level which
+ * are connected to the next level form the separator. Disconnected sets are
+ * split into their components.
+ */
+void SubmapSolver::partition(const std::vector<std::vector<int> > &adjacency, int maxSubmapSize,
+		std::vector<std::vector<int> > &leaves, std::vector<int> &separator) const
+{
+	int numVars = adjacency.size();
+	std::vector<int> owner(numVars, 0); // current set of each variable
+	std::vector<int> level(numVars, -1);
+	std::vector<std::vector<int> > stack(1);
+	for(int v=0; v<numVars; v++) stack[0].push_back(v);
+	int nextId = 1;
+	std::vector<int> order;
+
+	while(!stack.empty()){
+		std::vector<int> vars;
+		vars.swap(stack.back());
+		stack.pop_back();
+		if(vars.empty()) continue;
+		int id = owner[vars[0]];
+
+		int numLevels = bfs(vars[0], id, adjacency, owner, level, order);
+		if(order.size() < vars.size()){
+			// split into connected components:
+			resetLevels(vars, level);
+			for(size_t k=0; k<vars.size(); k++){
+				if(level[vars[k]] >= 0) continue;
+				bfs(vars[k], id, adjacency, owner, level, order);
+				for(size_t c=0; c<order.size(); c++) owner[order[c]] = nextId;
+				nextId++;
+				stack.push_back(order);
+			}
+			resetLevels(vars, level);
+			continue;
+		}
+		if((int)vars.size() <= maxSubmapSize){
+			resetLevels(vars, level);
+			leaves.push_back(vars);
+			continue;
+		}
+		// restart from the last variable found, which is far away from vars[0]:
+		int start = order.back();
+		resetLevels(vars, level);
+		numLevels = bfs(start, id, adjacency, owner, level, order);
+		if(numLevels < 3){
+			resetLevels(vars, level);
+			leaves.push_back(vars);
+			continue;
+		}
+		// the middle level splits the set in halves:
+		int mid = level[order[order.size()/2]];
+		mid = std::max(1, std::min(numLevels-2, mid));
+
+		int idA = nextId++, idB = nextId++;
+		std::vector<int> setA, setB;
+		for(size_t k=0; k<order.size(); k++){
+			int v = order[k];
+			if(level[v] < mid){
+				setA.push_back(v);
+			} else if(level[v] > mid){
+				setB.push_back(v);
+			} else {
+				bool coupled = false;
+				for(size_t a=0; a<adjacency[v].size() && !coupled; a++){
+					int u = adjacency[v][a];
+					coupled = owner[u] == id && level[u] == mid+1;
+				}
+				if(coupled) separator.push_back(v);
+				else setA.push_back(v);
+			}
+		}
+		resetLevels(vars, level);
+		for(size_t k=0; k<setA.size(); k++) owner[setA[k]] = idA;
+		for(size_t k=0; k<setB.size(); k++) owner[setB[k]] = idB;
+		for(size_t k=0; k<vars.size(); k++){
+			if(owner[vars[k]] == id) owner[vars[k]] = -1; // separator
+		}
+		stack.push_back(setB);
+		stack.push_back(setA);
+	}
+}
+
+
+/**
+ * Position of entry (row, col) in A->x, the rows of each column of A
+ * have to be sorted.
+ */
+static int entryPosition(const cs *A, int row, int col){
+	const int *begin = A->i + A->p[col], *end = A->i + A->p[col+1];
+	const int *it = std::lower_bound(begin, end, row);
+	assert(it != end && *it == row);
+	return it - A->i;
+}
+
+
+SubmapSolver::SubmapSolver(const cs *JtJ, const std::vector<std::vector<int> > &adjacency,
+		const std::vector<int> &columns, int maxSubmapSize) :
+	n(JtJ->n), sepBegin(0), sepDim(0), sepA(0), sepSymbolic(0), sepNumeric(0)
+{
+	int numVars = adjacency.size();
+	assert(columns.size() == adjacency.size() + 1 && columns[numVars] == n);
+	std::vector<std::vector<int> > leaves;
+	std::vector<int> separator;
+	partition(adjacency, maxSubmapSize, leaves, separator);
+	std::sort(separator.begin(), separator.end());
+
+	// permutation: the submaps one after another, then the separator
+	std::vector<int> submapOf(n, -1);
+	submaps.resize(leaves.size());
+	for(size_t s=0; s<leaves.size(); s++){
+		std::sort(leaves[s].begin(), leaves[s].end());
+		submaps[s].begin = perm.size();
+		for(size_t k=0; k<leaves[s].size(); k++){
+			int v = leaves[s][k];
+			for(int c=columns[v]; c<columns[v+1]; c++){
+				submapOf[perm.size()] = s;
+				perm.push_back(c);
+			}
+		}
+		submaps[s].end = perm.size();
+	}
+	sepBegin = perm.size();
+	for(size_t k=0; k<separator.size(); k++){
+		int v = separator[k];
+		for(int c=columns[v]; c<columns[v+1]; c++){
+			perm.push_back(c);
+		}
+	}
+	sepDim = n - sepBegin;
+	assert((int)perm.size() == n);
+
+	// Permute a copy of JtJ which holds the positions of the entries as values:
+	int nz = JtJ->p[n];
+	cs *positions = cs_spalloc(n, n, nz, true, false);
+	std::copy(JtJ->p, JtJ->p + n+1, positions->p);
+	std::copy(JtJ->i, JtJ->i + nz, positions->i);
+	for(int k=0; k<nz; k++) positions->x[k] = k;
+	std::vector<int> pinv(n);
+	for(int k=0; k<n; k++) pinv[perm[k]] = k;
+	cs *C = cs_symperm(positions, &pinv[0], true);
+	cs_spfree(positions);
+	assert(C);
+
+	// interior blocks:
+	for(size_t s=0; s<submaps.size(); s++){
+		Submap &sm = submaps[s];
+		int ni = sm.end - sm.begin;
+		int nzA = C->p[sm.end] - C->p[sm.begin];
+		sm.A = cs_spalloc(ni, ni, nzA, true, false);
+		int *cIdx = sm.A->p, *rIdx = sm.A->i;
+		*cIdx = 0;
+		for(int j=sm.begin; j<sm.end; j++){
+			for(int p=C->p[j]; p<C->p[j+1]; p++){
+				assert(C->i[p] >= sm.begin && C->i[p] <= j);
+				*rIdx++ = C->i[p] - sm.begin;
+				sm.Amap.push_back((int)C->x[p]);
+			}
+			*++cIdx = rIdx - sm.A->i;
+		}
+		sm.symbolic = cs_schol(1, sm.A);
+		sm.numeric = 0;
+		assert(sm.symbolic);
+		sm.couplingP.push_back(0);
+	}
+	// separator columns, sepRows[c] are the rows of column c of sepA:
+	std::vector<std::vector<int> > sepRows(sepDim);
+	std::vector<int> sepRow, sepCol;
+	for(int j=sepBegin; j<n; j++){
+		sepRows[j - sepBegin].push_back(j - sepBegin); // the diagonal
+		for(int p=C->p[j]; p<C->p[j+1]; p++){
+			int row = C->i[p], pos = (int)C->x[p];
+			if(row >= sepBegin){
+				sepRow.push_back(row - sepBegin);
+				sepCol.push_back(j - sepBegin);
+				sepMap.push_back(pos);
+				sepRows[j - sepBegin].push_back(row - sepBegin);
+			} else {
+				Submap &sm = submaps[submapOf[row]];
+				if(sm.sepCols.empty() || sm.sepCols.back() != j - sepBegin){
+					sm.sepCols.push_back(j - sepBegin);
+					sm.couplingP.push_back(sm.couplingP.back());
+				}
+				sm.couplingRow.push_back(row - sm.begin);
+				sm.couplingMap.push_back(pos);
+				sm.couplingP.back()++;
+			}
+		}
+	}
+	cs_spfree(C);
+
+	// each submap fills the block of its separator columns (sorted ascending):
+	for(size_t s=0; s<submaps.size(); s++){
+		const std::vector<int> &cols = submaps[s].sepCols;
+		for(size_t c=0; c<cols.size(); c++){
+			sepRows[cols[c]].insert(sepRows[cols[c]].end(), cols.begin(), cols.begin()+c);
+		}
+	}
+	int sepNz = 0;
+	for(int c=0; c<sepDim; c++){
+		std::sort(sepRows[c].begin(), sepRows[c].end());
+		sepRows[c].erase(std::unique(sepRows[c].begin(), sepRows[c].end()), sepRows[c].end());
+		sepNz += sepRows[c].size();
+	}
+	if(sepDim > 0){
+		sepA = cs_spalloc(sepDim, sepDim, sepNz, true, false);
+		sepA->p[0] = 0;
+		for(int c=0; c<sepDim; c++){
+			std::copy(sepRows[c].begin(), sepRows[c].end(), sepA->i + sepA->p[c]);
+			sepA->p[c+1] = sepA->p[c] + sepRows[c].size();
+		}
+		sepSymbolic = cs_schol(1, sepA);
+		assert(sepSymbolic);
+	}
+	for(size_t e=0; e<sepMap.size(); e++){
+		sepPos.push_back(entryPosition(sepA, sepRow[e], sepCol[e]));
+	}
+
+	for(size_t s=0; s<submaps.size(); s++){
+		Submap &sm = submaps[s];
+		int ni = sm.end - sm.begin, si = sm.sepCols.size();
+		sm.Y.resize(ni*si);
+		sm.z.resize(ni);
+		sm.S.resize(si*si);
+		sm.r.resize(si);
+		for(int c=0; c<si; c++){
+			for(int d=0; d<=c; d++){
+				sm.Smap.push_back(entryPosition(sepA, sm.sepCols[d], sm.sepCols[c]));
+			}
+		}
+	}
+	bPerm.resize(n);
+	sepWork.resize(sepDim);
+}
+
+SubmapSolver::~SubmapSolver(){
+	for(size_t s=0; s<submaps.size(); s++){
+		cs_spfree(submaps[s].A);
+		cs_sfree(submaps[s].symbolic);
+		cs_nfree(submaps[s].numeric);
+	}
+	cs_spfree(sepA);
+	cs_sfree(sepSymbolic);
+	cs_nfree(sepNumeric);
+}
+
+
+/**
+ * Factorizes the interior of submap k, solves it with the separator fixed
+ * and reduces it to the separator.
+ */
+void SubmapSolver::reduceSubmap(int k, const cs *JtJ){
+	Submap &sm = submaps[k];
+	int ni = sm.end - sm.begin, si = sm.sepCols.size();
+	for(size_t e=0; e<sm.Amap.size(); e++){
+		sm.A->x[e] = JtJ->x[sm.Amap[e]];
+	}
+	cs_nfree(sm.numeric);
+	sm.numeric = cs_chol(sm.A, sm.symbolic);
+	if(!sm.numeric) return;
+	const cs *L = sm.numeric->L;
+	const int *pinv = sm.symbolic->pinv;
+
+	double *z = &sm.z[0];
+	cs_ipvec(pinv, &bPerm[sm.begin], z, ni);
+	cs_lsolve(L, z);
+
+	std::vector<double> column(ni);
+	for(int c=0; c<si; c++){
+		std::fill(column.begin(), column.end(), 0);
+		for(int e=sm.couplingP[c]; e<sm.couplingP[c+1]; e++){
+			column[sm.couplingRow[e]] = JtJ->x[sm.couplingMap[e]];
+		}
+		double *y = &sm.Y[c*ni];
+		cs_ipvec(pinv, &column[0], y, ni);
+		cs_lsolve(L, y);
+	}
+	for(int c=0; c<si; c++){
+		const double *yc = &sm.Y[c*ni];
+		for(int d=0; d<=c; d++){
+			sm.S[c*si+d] = sm.S[d*si+c] = std::inner_product(yc, yc+ni, &sm.Y[d*ni], 0.0);
+		}
+		sm.r[c] = std::inner_product(yc, yc+ni, z, 0.0);
+	}
+}
+
+/**
+ * Calculates the interior of submap k from the separator solution.
+ */
+void SubmapSolver::updateSubmap(int k){
+	Submap &sm = submaps[k];
+	int ni = sm.end - sm.begin, si = sm.sepCols.size();
+	const double *xs = &bPerm[sepBegin];
+	double *z = &sm.z[0];
+	for(int c=0; c<si; c++){
+		double x = xs[sm.sepCols[c]];
+		const double *y = &sm.Y[c*ni];
+		for(int i=0; i<ni; i++) z[i] -= y[i] * x;
+	}
+	cs_ltsolve(sm.numeric->L, z);
+	cs_pvec(sm.symbolic->pinv, z, &bPerm[sm.begin], ni);
+}
+
+struct SubmapSolver::ReduceBody {
+	SubmapSolver *solver;
+	const cs *JtJ;
+	void operator()(int k) const {
+		solver->reduceSubmap(k, JtJ);
+	}
+};
+
+struct SubmapSolver::UpdateBody {
+	SubmapSolver *solver;
+	void operator()(int k) const {
+		solver->updateSubmap(k);
+	}
+};
+
+
+bool SubmapSolver::solve(const cs *JtJ, double *b, ThreadPool &pool){
+	assert(JtJ->n == n);
+	for(int k=0; k<n; k++) bPerm[k] = b[perm[k]];
+
+	ReduceBody reduce = {this, JtJ};
+	pool.parallelFor(submaps.size(), reduce);
+	for(size_t s=0; s<submaps.size(); s++){
+		if(!submaps[s].numeric) return false;
+	}
+
+	// the separator system, submaps are subtracted in a fixed order:
+	double *bs = &bPerm[sepBegin];
+	if(sepDim > 0){
+		double *Sx = sepA->x;
+		std::fill_n(Sx, sepA->p[sepDim], 0);
+		for(size_t e=0; e<sepMap.size(); e++){
+			Sx[sepPos[e]] = JtJ->x[sepMap[e]];
+		}
+		for(size_t s=0; s<submaps.size(); s++){
+			const Submap &sm = submaps[s];
+			int si = sm.sepCols.size();
+			int e = 0;
+			for(int c=0; c<si; c++){
+				for(int d=0; d<=c; d++){
+					Sx[sm.Smap[e++]] -= sm.S[c*si+d];
+				}
+				bs[sm.sepCols[c]] -= sm.r[c];
+			}
+		}
+		cs_nfree(sepNumeric);
+		sepNumeric = cs_chol(sepA, sepSymbolic);
+		if(!sepNumeric) return false;
+		double *x = &sepWork[0];
+		cs_ipvec(sepSymbolic->pinv, bs, x, sepDim);
+		cs_lsolve(sepNumeric->L, x);
+		cs_ltsolve(sepNumeric->L, x);
+		cs_pvec(sepSymbolic->pinv, x, bs, sepDim);
+	}
+
+	UpdateBody update = {this};
+	pool.parallelFor(submaps.size(), update);
+
+	for(int k=0; k<n; k++) b[perm[k]] = bPerm[k];
+	return true;
+}
+
+
+long SubmapSolver::getFactorNonZeros() const{
+	long nnz = sepNumeric ? sepNumeric->L->p[sepDim] : 0;
+	for(size_t s=0; s<submaps.size(); s++){
+		const Submap &sm = submaps[s];
+		if(sm.numeric) nnz += sm.numeric->L->p[sm.A->n];
+	}
+	return nnz;
+}
+
+
+}  // namespace SLOM
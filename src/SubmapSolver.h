@@ -0,0 +1,114 @@
+#ifndef SUBMAPSOLVER_H_
+#define SUBMAPSOLVER_H_
+
+#include "tools/ThreadPool.h"
+
+#include <vector>
+
+#include <cs.h>
+
+namespace SLOM {
+
+/**
+ * Solves the normal equations $J^T J x = b$ by partitioning the variables
+ * into submaps using nested dissection on the variable adjacency.
+ * Variables of different submaps share no measurement, they are only
+ * coupled via the separator variables.
+ *
+ * Each step the interior of every submap is factorized and solved with the
+ * separator fixed, and its influence is reduced to the separator system
+ * (the Schur complement), all submaps in parallel.
+ * Then the separator system is solved and the interiors are updated
+ * from the result, again in parallel.
+ * A submap only fills in the separator block of its own separator
+ * variables, so the separator system stays sparse and is factorized
+ * like JtJ itself with a fill reducing ordering.
+ */
+class SubmapSolver
+{
+public:
+	/**
+	 * Sets up the partition and the symbolic decompositions.
+	 * JtJ is the upper triangle of the normal equations, only its
+	 * structure is used. adjacency[v] are the variables sharing a
+	 * measurement with variable v, columns[v] is the first column of
+	 * variable v and columns[numVars] == JtJ->n.
+	 * Submaps have at most maxSubmapSize variables, unless they can't
+	 * be split anymore.
+	 */
+	SubmapSolver(const cs *JtJ, const std::vector<std::vector<int> > &adjacency,
+			const std::vector<int> &columns, int maxSubmapSize);
+	~SubmapSolver();
+
+	/**
+	 * Solves JtJ x = b, b is overwritten by x. JtJ must have the
+	 * structure passed to the constructor.
+	 * Returns false if JtJ is not positive definite.
+	 */
+	bool solve(const cs *JtJ, double *b, ThreadPool &pool);
+
+	int getNumSubmaps() const { return submaps.size(); }
+
+	/**
+	 * Number of columns of the separator system.
+	 */
+	int getSeparatorDim() const { return sepDim; }
+
+	/**
+	 * Non-zeros of the factors of the last solve(), including the
+	 * separator factor.
+	 */
+	long getFactorNonZeros() const;
+
+private:
+	struct Submap {
+		int begin, end;           // columns in the permuted order
+		cs *A;                    // upper triangle of the interior block
+		std::vector<int> Amap;    // position in JtJ->x of each entry of A
+		css *symbolic;
+		csn *numeric;
+
+		// The coupling to the separator: column sepCols[k] of the separator
+		// has the entries [couplingP[k], couplingP[k+1]) with rows couplingRow
+		// in the submap and positions couplingMap in JtJ->x.
+		std::vector<int> sepCols, couplingP, couplingRow, couplingMap;
+
+		std::vector<double> Y;    // $L^{-1} P E$, column major, E is the coupling
+		std::vector<double> z;    // $L^{-1} P b$
+		std::vector<double> S;    // $Y^T Y$, reduced to the separator
+		std::vector<double> r;    // $Y^T z$
+		std::vector<int> Smap;    // position in sepA->x of S[c*si+d] for d<=c
+	};
+	std::vector<Submap> submaps;
+
+	int n;            // number of columns
+	int sepBegin;     // first separator column in the permuted order
+	int sepDim;       // number of separator columns
+	std::vector<int> perm;  // perm[k] is the column of JtJ at position k
+
+	// upper triangle of the separator system, its entries from the
+	// separator block of JtJ are at sepPos with positions sepMap in JtJ->x
+	cs *sepA;
+	std::vector<int> sepPos, sepMap;
+	css *sepSymbolic;
+	csn *sepNumeric;
+
+	// workspace:
+	std::vector<double> bPerm; // permuted right hand side and solution
+	std::vector<double> sepWork;
+
+	void partition(const std::vector<std::vector<int> > &adjacency, int maxSubmapSize,
+			std::vector<std::vector<int> > &leaves, std::vector<int> &separator) const;
+	void reduceSubmap(int k, const cs *JtJ);
+	void updateSubmap(int k);
+	struct ReduceBody;
+	struct UpdateBody;
+
+	// not copyable:
+	SubmapSolver(const SubmapSolver&);
+	SubmapSolver& operator=(const SubmapSolver&);
+};
+
+}  // namespace SLOM
+
+#endif /*SUBMAPSOLVER_H_*/
@@ -0,0 +1,50 @@
+#ifndef MATRIX_H_
+#define MATRIX_H_
+
+#include "Vect.h"
+#include "../tools/MatrixKernels.h"
+
+namespace SLOM {
+
+
+/**
+ * Dense matrix of fixed size RxC, stored row major.
+ * As a manifold it behaves like Vect<R*C>.
+ */
+template<int R, int C>
+struct Matrix : public Vect<R*C>{
+	enum {ROWS = R, COLS = C};
+
+	Matrix() {}
+
+	Matrix(const double* src) : Vect<R*C>(src) {}
+
+	double& operator()(int r, int c) {return this->data[r*C + c]; }
+	const double& operator()(int r, int c) const {return this->data[r*C + c]; }
+
+	/**
+	 * res = (*this) * vec
+	 */
+	void mul(double res[R], const double vec[C]) const {
+		MatrixKernels::mul<R, C>(res, this->data, vec);
+	}
+
+	/**
+	 * res -= (*this)' * vec
+	 */
+	void transposedSubMul(double res[C], const double vec[R]) const {
+		MatrixKernels::transposedSubMul<R, C>(res, this->data, vec);
+	}
+
+	Vect<R> operator*(const Vect<C> &vec) const {
+		Vect<R> res;
+		mul(res.data, vec.data);
+		return res;
+	}
+};
+
+
+}  // namespace SLOM
+
+
+#endif /*MATRIX_H_*/
@@ -5,6 +5,8 @@
 #include "../tools/quaternion.h"
 #include "Vect.h"
 
+#include <algorithm>
+
 namespace SLOM {
 
 
@@ -64,41 +66,117 @@ struct RotationGroup {
 /**
  * Rotations in 3D.
  * In this implementation rotations are represented as quaternions.
+ * The corresponding rotation matrix is calculated on demand and cached
+ * until the rotation is modified. Rotating is thread-safe.
  */
 struct SO3 : public Manifold<SO3, 3>, public RotationGroup<SO3, 3>{
-	Quaternion quat;
 	// Requirements for Manifold:
 	void add_(const double vec[3], double scale=1){
 		Quaternion q(vec, scale);
 		quat*=q;
+		rotState = INVALID;
 	}
 	void sub_(double res[3], const SO3& oth) const{
-		Quaternion tmp = quat % oth.quat; // this^-1 * oth
+		Quaternion tmp = oth.quat % quat; // oth^-1 * this, so oth.add(res) == this
 		tmp.toScaledAxis(res);
 	}
 	///
 	
-	SO3(const Quaternion &q=Quaternion()) : quat(q) {}
+	SO3(const Quaternion &q=Quaternion()) : quat(q), rot(), rotState(INVALID) {}
 	
+	SO3(const SO3 &oth) : quat(oth.quat), rot(), rotState(INVALID) {
+		copyCache(oth);
+	}
+	
+	SO3& operator=(const SO3 &oth){
+		if(this != &oth){
+			quat = oth.quat;
+			rotState = INVALID;
+			copyCache(oth);
+		}
+		return *this;
+	}
+	
+	const Quaternion& quaternion() const { return quat; }
 	
 	/**
 	 * multiplies (*this) by oth, inverting this or oth priorly if requested.
 	 */
 	void mult(const SO3& oth, bool invThis, bool invOth){
 		quat.multiply(oth.quat, invThis, invOth);
+		rotState = INVALID;
 	}
 
 	/**
 	 * Rotates a 3D Vector (backwards if requested).
 	 */
 	void rotate(Vect<3> &res, const Vect<3> &vec, bool back=false) const {
-		quat.rotate(res.data, vec.data, back);
+		rotate(res.data, vec.data, back);
 	}
 
+	/**
+	 * Rotates vec (backwards if requested) and stores the result in res.
+	 * vec and res can point to the same address.
+	 */
 	void rotate(double res[3], const double vec[3], bool back=false) const {
-		quat.rotate(res, vec, back);
+		double tmp[9];
+		const double *R = matrix(tmp);
+		double X=vec[0], Y=vec[1], Z=vec[2];
+		if(back){
+			res[0] = R[0]*X + R[3]*Y + R[6]*Z;
+			res[1] = R[1]*X + R[4]*Y + R[7]*Z;
+			res[2] = R[2]*X + R[5]*Y + R[8]*Z;
+		} else {
+			res[0] = R[0]*X + R[1]*Y + R[2]*Z;
+			res[1] = R[3]*X + R[4]*Y + R[5]*Z;
+			res[2] = R[6]*X + R[7]*Y + R[8]*Z;
+		}
 	}
 
+private:
+	Quaternion quat;
+	
+	/**
+	 * rotation matrix of quat (row major), only valid if rotState == VALID.
+	 * As measurements are evaluated concurrently, the cache is filled
+	 * by the first thread which claims it (INVALID -> BUSY -> VALID),
+	 * all others use their own copy meanwhile.
+	 */
+	mutable double rot[9];
+	mutable int rotState;
+	enum {INVALID, BUSY, VALID};
+	
+	/**
+	 * Returns the rotation matrix, either the cached one or tmp.
+	 */
+	const double* matrix(double tmp[9]) const {
+		if(__atomic_load_n(&rotState, __ATOMIC_ACQUIRE) == VALID){
+			return rot;
+		}
+		// same terms as in Quaternion::rotate
+		double w=quat.w, x=quat.x, y=quat.y, z=quat.z;
+		double
+			wx=w*x, xx=x*x,
+			wy=w*y, xy=x*y, yy=y*y,
+			wz=w*z, xz=x*z, yz=y*z, zz=z*z;
+		tmp[0] = 1-2*zz-2*yy; tmp[1] = 2*(xy-wz);     tmp[2] = 2*(wy+xz);
+		tmp[3] = 2*(xy+wz);   tmp[4] = 1-2*zz-2*xx;   tmp[5] = 2*(yz-wx);
+		tmp[6] = 2*(xz-wy);   tmp[7] = 2*(yz+wx);     tmp[8] = 1-2*yy-2*xx;
+		int expected = INVALID;
+		if(__atomic_compare_exchange_n(&rotState, &expected, (int)BUSY, false,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+			std::copy(tmp, tmp+9, rot);
+			__atomic_store_n(&rotState, (int)VALID, __ATOMIC_RELEASE);
+		}
+		return tmp;
+	}
+	
+	void copyCache(const SO3 &oth){
+		if(__atomic_load_n(&oth.rotState, __ATOMIC_ACQUIRE) == VALID){
+			std::copy(oth.rot, oth.rot+9, rot);
+			rotState = VALID;
+		}
+	}
 };
 
 
@@ -106,30 +184,38 @@ struct SO3 : public Manifold<SO3, 3>, public RotationGroup<SO3, 3>{
 
 /**
  * Rotations in 2D (simple Rotations).
- * 
+ * Besides the angle, cos(angle) and sin(angle) are stored, so rotating
+ * a vector needs no trigonometric function calls.
  */
 struct SO2 : public Manifold<SO2, 1>, public RotationGroup<SO2,2>{
-	double angle;
-	SO2(double angle = 0) : angle(angle) {}
-	SO2(const Vect<2> &dir) : angle(atan2(dir[1], dir[0])) {}
+	SO2(double angle = 0) : angle(angle) { updateTrig(); }
+	SO2(const Vect<2> &dir) : angle(atan2(dir[1], dir[0])) { updateTrig(); }
 	
 	void add_(const double vec[1], double scale=1){
 		angle += scale*vec[0];
+		updateTrig();
 	}
 	void sub_(double res[1], const SO2& oth) const{
 		res[0] = normalize(angle-oth.angle);
 	}
 	
 	void mult(const SO2& oth, bool invThis, bool invOth){
-		if(invThis) angle = -angle;
+		if(invThis){
+			angle = -angle; s = -s;
+		}
+		double oc = oth.c, os = invOth ? -oth.s : oth.s;
 		angle += invOth ? -oth.angle : oth.angle;
+		// (c + i*s) * (oc + i*os):
+		double nc = c*oc - s*os;
+		s = s*oc + c*os;
+		c = nc;
 	}
 	
 	void rotate(double res[2], const double vec[2], bool back=false) const{
-		double c=cos(angle), s= back ? -sin(angle) : sin(angle);
+		double s_ = back ? -s : s;
 		double x=vec[0], y = vec[1];
-		res[0] = c*x - s*y;
-		res[1] = s*x + c*y;
+		res[0] = c*x - s_*y;
+		res[1] = s_*x + c*y;
 	}
 
 	void rotate(Vect<2> &res, const Vect<2> &vec, bool back=false) const{
@@ -138,6 +224,13 @@ struct SO2 : public Manifold<SO2, 1>, public RotationGroup<SO2,2>{
 	
 	operator double() const {return angle;}
 private:
+	double angle;
+	double c, s; // cos(angle) and sin(angle)
+	
+	void updateTrig(){
+		c = cos(angle); s = sin(angle);
+	}
+	
 	static inline double normalize(double x){
 		if(fabs(x) <= M_PI) return x;
 		int r = (int)(x*M_1_PI);
@@ -2,6 +2,7 @@
 #define VECT_H_
 
 #include "../types/Manifold.h"
+#include "../tools/MatrixKernels.h"
 
 namespace SLOM {
 
@@ -11,23 +12,18 @@ struct Vect : public Manifold<Vect<D>,D>{
 	double data[D];
 	
 	Vect(){
-		for(int i=0; i<D; i++) data[i]=0;
+		MatrixKernels::fill<D>(data, 0);
 	}
 	
 	Vect(const double* src){
-		for(int i=0; i<D; i++)
-			data[i] = *src++;
+		MatrixKernels::copy<D>(data, src);
 	}
 	
 	void add_(const double vec[D], double scale=1){
-		for(int i=0; i<D; i++){
-			data[i]+= scale * *vec++;
-		}
+		MatrixKernels::addScaled<D>(data, vec, scale);
 	}
 	void sub_(double res[D], const Vect<D>& oth) const {
-		for(int i=0; i<D; i++){
-			*res++ = data[i]-oth.data[i];
-		}
+		MatrixKernels::sub<D>(res, data, oth.data);
 	}
 	
 	double& operator[](int idx) {return data[idx]; }
@@ -73,7 +73,7 @@ struct name : public SLOM::IMeasurement { \
 		SEQ_FOR_EACH(MEASUREMENT_GENERATE_DEPEND, variables);} \
 	int registerVariables() const{ return 0\
 		SEQ_FOR_EACH(MEASUREMENT_GENERATE_REGISTER, variables);} \
-	name& operator=(const name& f){ return *(new(this)name(f)); }\
+	name& operator=(const name& f){ if(this != &f){ this->~name(); new(this)name(f);} return *this; }\
 	int getDim() const { return dim; } \
 	double* eval(double *ret) const; \
 };
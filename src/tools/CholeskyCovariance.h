@@ -3,8 +3,11 @@
 
 #include <algorithm>
 #include <numeric>
+#include <cmath>
 #include <cassert>
 
+#include "MatrixKernels.h"
+
 namespace SLOM {
 
 
@@ -31,6 +34,8 @@ struct CholeskyCovariance
 	enum {DIM = dim, SIZE = (dim*(dim+1))/2};
 	// chol is a lower triangular matrix, saved in row major order
 	double chol[SIZE];
+	// invChol is the inverse of chol, saved the same way
+	double invChol[SIZE];
 
 
 	CholeskyCovariance() {};
@@ -58,18 +63,19 @@ struct CholeskyCovariance
 	void copyCholesky(const double *A, bool skip){
 		if(skip){
 			std::copy(A, A+SIZE, chol);
-			return;
-		}
-		const double *a = A;
-		double *coli = chol;
-		for(int i=1; i<=DIM; i++){
-			for(int j=0; j<i; j++){
-				*coli++ = *a++;
+		} else {
+			const double *a = A;
+			double *coli = chol;
+			for(int i=1; i<=DIM; i++){
+				for(int j=0; j<i; j++){
+					*coli++ = *a++;
+				}
+				a += DIM-i;
 			}
-			a += DIM-i;
+			assert(a==A+DIM*DIM);
+			assert(coli == chol+SIZE);
 		}
-		assert(a==A+DIM*DIM);
-		assert(coli == chol+SIZE);
+		calculateInverse();
 	}
 
 	/**
@@ -101,6 +107,28 @@ struct CholeskyCovariance
 			}
 		}
 		assert(skip ? (a==A+SIZE) : (a==A+DIM*DIM));
+		calculateInverse();
+	}
+
+	/**
+	 * Calculates invChol from chol. copyCholesky() and calculateCholesky()
+	 * call it, it only has to be called when chol is changed directly.
+	 */
+	void calculateInverse(){
+		for(int i=0; i<DIM; i++){
+			const double *ci = chol + (i*(i+1))/2; // row i of chol
+			double *inv = invChol + (i*(i+1))/2;   // row i of invChol
+			double d = 1/ci[i];
+			for(int j=0; j<i; j++){
+				// Inv(i,j) = -C(i,j:i)*Inv(j:i,j)/C(i,i)
+				double sum = 0;
+				for(int k=j; k<i; k++){
+					sum += ci[k] * invChol[(k*(k+1))/2 + j];
+				}
+				inv[j] = -sum * d;
+			}
+			inv[i] = d;
+		}
 	}
 
 	/**
@@ -108,14 +136,7 @@ struct CholeskyCovariance
 	 * I.e. computes chol\arr;
 	 */
 	void invApply(double* arr) const {
-		const double *c = chol;
-		for(double *a = arr; a < arr + DIM; a++){
-			double ai = *a;
-			for(double *b=arr; b<a; b++){
-				ai -= *c++ * *b;
-			}
-			*a = ai / *c++;
-		}
+		MatrixKernels::lowerMul<DIM>(invChol, arr);
 	}
 
 	/**
@@ -123,14 +144,7 @@ struct CholeskyCovariance
 	 * I.e. computes chol*arr;
 	 */
 	void apply(double *arr) const {
-		const double *c = chol + SIZE -1;
-		for(double *a=arr + DIM - 1; a >= arr; --a){
-			*a *= *c--;
-			for(double *b = a-1; b>= arr; b--){
-				*a += *c-- * *b;
-			}
-		}
-
+		MatrixKernels::lowerMul<DIM>(chol, arr);
 	}
 };
 
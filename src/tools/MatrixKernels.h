@@ -0,0 +1,179 @@
+#ifndef MATRIXKERNELS_H_
+#define MATRIXKERNELS_H_
+
+namespace SLOM {
+
+/**
+ * Kernels for small dense vectors and matrices of fixed size.
+ * All dimensions are template parameters and all loops over them are
+ * unrolled at compile time by Unroll<N>, so the compiler sees straight-line
+ * code, which it can keep in registers and vectorize.
+ * Matrices are stored row major, packed triangular matrices are stored
+ * row major as well, i.e. L(i,j) is at index i*(i+1)/2+j.
+ */
+namespace MatrixKernels {
+
+/**
+ * Unroll<N>::run(op) calls op(0), op(1), ..., op(N-1).
+ */
+template<int N>
+struct Unroll {
+	template<typename Op>
+	static inline void run(Op &op){
+		Unroll<N-1>::run(op);
+		op(N-1);
+	}
+};
+
+template<>
+struct Unroll<0> {
+	template<typename Op>
+	static inline void run(Op &){}
+};
+
+
+namespace Op {
+struct Fill {
+	double *y; double v;
+	inline void operator()(int i) const { y[i] = v; }
+};
+struct Copy {
+	double *y; const double *x;
+	inline void operator()(int i) const { y[i] = x[i]; }
+};
+struct AddScaled {
+	double *y; const double *x; double s;
+	inline void operator()(int i) const { y[i] += s * x[i]; }
+};
+struct Sub {
+	double *res; const double *a; const double *b;
+	inline void operator()(int i) const { res[i] = a[i] - b[i]; }
+};
+struct Dot {
+	const double *a; const double *b; double sum;
+	inline void operator()(int i) { sum += a[i] * b[i]; }
+};
+template<int C>
+struct MulRow {
+	double *res; const double *M; const double *vec;
+	inline void operator()(int i) const {
+		Dot dot = {M + i*C, vec, 0};
+		Unroll<C>::run(dot);
+		res[i] = dot.sum;
+	}
+};
+template<int C>
+struct TransposedSubRow {
+	double *res; const double *M; const double *vec;
+	inline void operator()(int i) const {
+		AddScaled axpy = {res, M + i*C, -vec[i]};
+		Unroll<C>::run(axpy);
+	}
+};
+template<int I>
+struct LowerRowSum {
+	const double *li; const double *arr; double sum;
+	// accumulates li[j]*arr[j] for j = I-1, ..., 0
+	inline void operator()(int k) { sum += li[I-1-k] * arr[I-1-k]; }
+};
+}  // namespace Op
+
+
+/**
+ * LowerRows<I>::run(L, arr) sets arr[i] = L(i,0:i)*arr[0:i] for i = I, ..., 0.
+ * As rows are processed from last to first this works in place.
+ */
+template<int I>
+struct LowerRows {
+	static inline void run(const double *L, double *arr){
+		const double *li = L + (I*(I+1))/2;
+		Op::LowerRowSum<I> op = {li, arr, arr[I] * li[I]};
+		Unroll<I>::run(op);
+		arr[I] = op.sum;
+		LowerRows<I-1>::run(L, arr);
+	}
+};
+
+template<>
+struct LowerRows<-1> {
+	static inline void run(const double *, double *){}
+};
+
+
+/**
+ * y[0,N) = v
+ */
+template<int N>
+inline void fill(double *y, double v){
+	Op::Fill op = {y, v};
+	Unroll<N>::run(op);
+}
+
+/**
+ * y[0,N) = x[0,N)
+ */
+template<int N>
+inline void copy(double *y, const double *x){
+	Op::Copy op = {y, x};
+	Unroll<N>::run(op);
+}
+
+/**
+ * y[0,N) += s*x[0,N)
+ */
+template<int N>
+inline void addScaled(double *y, const double *x, double s=1){
+	Op::AddScaled op = {y, x, s};
+	Unroll<N>::run(op);
+}
+
+/**
+ * res[0,N) = a[0,N) - b[0,N)
+ */
+template<int N>
+inline void sub(double *res, const double *a, const double *b){
+	Op::Sub op = {res, a, b};
+	Unroll<N>::run(op);
+}
+
+/**
+ * returns a[0,N)' * b[0,N)
+ */
+template<int N>
+inline double dot(const double *a, const double *b){
+	Op::Dot op = {a, b, 0};
+	Unroll<N>::run(op);
+	return op.sum;
+}
+
+/**
+ * res = M*vec, for an RxC matrix M. res and vec must not overlap.
+ */
+template<int R, int C>
+inline void mul(double *res, const double *M, const double *vec){
+	Op::MulRow<C> op = {res, M, vec};
+	Unroll<R>::run(op);
+}
+
+/**
+ * res -= M'*vec, for an RxC matrix M. res and vec must not overlap.
+ */
+template<int R, int C>
+inline void transposedSubMul(double *res, const double *M, const double *vec){
+	Op::TransposedSubRow<C> op = {res, M, vec};
+	Unroll<R>::run(op);
+}
+
+/**
+ * arr = L*arr, for a packed lower triangular DxD matrix L.
+ */
+template<int D>
+inline void lowerMul(const double *L, double *arr){
+	LowerRows<D-1>::run(L, arr);
+}
+
+}  // namespace MatrixKernels
+
+}  // namespace SLOM
+
+#endif /*MATRIXKERNELS_H_*/
@@ -0,0 +1,121 @@
+#ifndef NOISEMODEL_H_
+#define NOISEMODEL_H_
+
+#include "CholeskyCovariance.h"
+
+#include <map>
+#include <pthread.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace SLOM {
+
+/**
+ * Noise models which can be used instead of CholeskyCovariance inside
+ * measurements. All provide apply(arr) and invApply(arr).
+ */
+
+
+/**
+ * Unit covariance. Whitening does nothing, so the compiler removes it
+ * completely and the measurement does not store any noise data.
+ */
+template<int dim>
+struct IdentityCovariance
+{
+	enum {DIM = dim};
+	void apply(double *) const {}
+	void invApply(double *) const {}
+};
+
+
+/**
+ * Handle to a shared, reference counted CholeskyCovariance.
+ * Covariances are interned, i.e. all handles created from identical
+ * factors refer to the same object, which is deleted when the last
+ * handle is gone. Thus thousands of measurements with the same
+ * covariance need only one copy of it.
+ * The pool is guarded by a mutex, so handles can be created and
+ * destroyed from several threads.
+ */
+template<int dim>
+class SharedCovariance
+{
+	typedef CholeskyCovariance<dim> Cov;
+	boost::shared_ptr<const Cov> cov;
+public:
+	enum {DIM = dim};
+
+	SharedCovariance(const Cov& c) : cov(intern(c)) {}
+	SharedCovariance(const double *A, CholeskyMode::CM mode) : cov(intern(Cov(A, mode))) {}
+
+	void apply(double *arr) const { cov->apply(arr); }
+	void invApply(double *arr) const { cov->invApply(arr); }
+
+	const Cov& operator*() const { return *cov; }
+	const Cov* operator->() const { return cov.get(); }
+
+	/**
+	 * Number of distinct covariances currently in use.
+	 */
+	static int poolSize() {
+		Lock l;
+		return pool().size();
+	}
+
+private:
+	struct Less {
+		bool operator()(const Cov& a, const Cov& b) const {
+			return std::lexicographical_compare(a.chol, a.chol+Cov::SIZE, b.chol, b.chol+Cov::SIZE);
+		}
+	};
+	typedef std::map<Cov, boost::weak_ptr<const Cov>, Less> Pool;
+
+	static Pool& pool() {
+		static Pool p;
+		return p;
+	}
+
+	static pthread_mutex_t* mutex() {
+		static pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+		return &m;
+	}
+
+	struct Lock {
+		Lock() { pthread_mutex_lock(mutex()); }
+		~Lock() { pthread_mutex_unlock(mutex()); }
+	};
+
+	/**
+	 * Deleter of the pooled covariances, removes the pool entry.
+	 * The entry may already refer to a new copy, if intern() ran after the
+	 * last handle was dropped but before this deleter, so that is kept.
+	 */
+	struct Release {
+		void operator()(const Cov *c) const {
+			{
+				Lock l;
+				Pool &p = pool();
+				typename Pool::iterator it = p.find(*c);
+				if(it != p.end() && it->second.expired()) p.erase(it);
+			}
+			delete c;
+		}
+	};
+
+	static boost::shared_ptr<const Cov> intern(const Cov& c) {
+		Lock l;
+		boost::weak_ptr<const Cov> &entry = pool()[c];
+		boost::shared_ptr<const Cov> res = entry.lock();
+		if(!res){
+			res.reset(new Cov(c), Release());
+			entry = res;
+		}
+		return res;
+	}
+};
+
+
+}  // namespace SLOM
+
+#endif /*NOISEMODEL_H_*/
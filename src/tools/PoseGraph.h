@@ -0,0 +1,361 @@
+#ifndef POSEGRAPH_H_
+#define POSEGRAPH_H_
+
+#include "CholeskyCovariance.h"
+#include "../types/RandomVariable.h"
+#include "../types/Measurement.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace SLOM {
+
+/**
+ * Edges of pose graphs and the math on them, shared by SpanningTree,
+ * Multilevel, Sparsifier and Aggregator.
+ *
+ * Pose_T has to provide local2World() and world2Local() like the poses
+ * of MAKE_POSE. An edge (from, to, delta, information) is the measurement
+ * $from.world2Local(to) \boxminus delta$, whitened by applying the
+ * Cholesky factor L of its information matrix like CholeskyCovariance
+ * does (see PoseGraphMeasurement). information is the full DOF x DOF
+ * matrix in row major order, as passed to CholeskyCovariance with
+ * CholeskyMode::CHOLESKY_FULL. The measurement thus has the weight
+ * $W = L^T L$, which only equals the information matrix if that is
+ * diagonal. Derived edges are computed with the weights and converted
+ * back with PoseGraph::whitening(), so they are whitened the same way.
+ */
+template<typename Pose_T>
+struct PoseGraphEdge
+{
+	enum {DOF = Pose_T::DOF};
+
+	int from, to;
+	Pose_T delta;
+	double information[DOF*DOF];
+
+	PoseGraphEdge() : from(-1), to(-1) {}
+
+	/**
+	 * Only the upper triangle of information is used.
+	 */
+	PoseGraphEdge(int from, int to, const Pose_T &delta, const double *information) :
+		from(from), to(to), delta(delta)
+	{
+		for(int i=0; i<DOF; i++){
+			for(int j=i; j<DOF; j++){
+				this->information[i*DOF+j] = this->information[j*DOF+i] = information[i*DOF+j];
+			}
+		}
+	}
+
+	/**
+	 * The relative pose of the other end seen from pose id, which is from or to.
+	 */
+	Pose_T relativeFrom(int id) const {
+		return id == from ? delta : delta.world2Local(Pose_T());
+	}
+
+	/**
+	 * The same measurement seen from to, with the weight transformed by
+	 * the Jacobian of the inverse pose.
+	 */
+	void reverse(PoseGraphEdge &result) const;
+
+	/**
+	 * Composes the edges a->v and v->b into the edge a->b, the covariances
+	 * are propagated to first order.
+	 */
+	static void compose(const PoseGraphEdge &first, const PoseGraphEdge &second, PoseGraphEdge &result);
+
+	/**
+	 * Fuses two edges between the same poses in the same direction:
+	 * the weights are added and the relative pose is their weighted mean,
+	 * taken in the tangent space of a.delta.
+	 */
+	static void fuse(const PoseGraphEdge &a, const PoseGraphEdge &b, PoseGraphEdge &result);
+};
+
+
+/**
+ * A PoseGraphEdge between two variables for the Estimator.
+ */
+template<typename Pose_T>
+struct PoseGraphMeasurement : public IMeasurement
+{
+	enum {DOF = Pose_T::DOF};
+	typedef RVWrapper<Pose_T> Pose;
+
+	Pose &t0, &t1;
+	Pose_T delta;
+	CholeskyCovariance<DOF> cov;
+
+	PoseGraphMeasurement(Pose &t0, Pose &t1, const PoseGraphEdge<Pose_T> &e) :
+		t0(t0), t1(t1), delta(e.delta), cov(e.information, CholeskyMode::CHOLESKY_FULL) {}
+
+	double* eval(double *ret) const {
+		Pose_T diff = t0->world2Local(*t1);
+		diff.sub(ret, delta);
+		cov.apply(ret);
+		return ret+DOF;
+	}
+private:
+	int getDim() const { return DOF; }
+	int getDepend() const { return 2*DOF; }
+	int registerVariables() const {
+		return t0.registerMeasurement(this) + t1.registerMeasurement(this);
+	}
+};
+
+
+namespace PoseGraph {
+
+/**
+ * A = A^{-1} for a symmetric positive definite, row major n x n matrix.
+ * Returns false if A is not positive definite.
+ */
+inline bool invert(double *A, int n){
+	// A = L L^T, L overwrites the lower triangle:
+	for(int j=0; j<n; j++){
+		double d = A[j*n+j];
+		for(int k=0; k<j; k++) d -= A[j*n+k] * A[j*n+k];
+		if(!(d > 0)) return false;
+		d = std::sqrt(d);
+		A[j*n+j] = d;
+		for(int i=j+1; i<n; i++){
+			double s = A[i*n+j];
+			for(int k=0; k<j; k++) s -= A[i*n+k] * A[j*n+k];
+			A[i*n+j] = s / d;
+		}
+	}
+	// L^{-1} in the lower triangle:
+	for(int j=0; j<n; j++){
+		A[j*n+j] = 1 / A[j*n+j];
+		for(int i=j+1; i<n; i++){
+			double s = 0;
+			for(int k=j; k<i; k++) s -= A[i*n+k] * A[k*n+j];
+			A[i*n+j] = s / A[i*n+i];
+		}
+	}
+	// A^{-1} = L^{-T} L^{-1}:
+	for(int i=0; i<n; i++){
+		for(int j=0; j<=i; j++){
+			double s = 0;
+			for(int k=i; k<n; k++) s += A[k*n+i] * A[k*n+j];
+			A[j*n+i] = s;
+		}
+	}
+	for(int i=0; i<n; i++){
+		for(int j=0; j<i; j++) A[i*n+j] = A[j*n+i];
+	}
+	return true;
+}
+
+/**
+ * log det(A) of a symmetric positive definite DOF x DOF matrix.
+ */
+template<int DOF>
+double logDet(const double *A){
+	CholeskyCovariance<DOF> chol(A, CholeskyMode::CHOLESKY_FULL);
+	double sum = 0;
+	for(int k=0; k<DOF; k++){
+		sum += 2*std::log(chol.chol[k*(k+1)/2+k]);
+	}
+	return sum;
+}
+
+/**
+ * result = J A J^T, or J^T A J if transposed, for n x n matrices.
+ * result must not overlap J or A.
+ */
+inline void transform(const double *J, const double *A, double *result, int n, bool transposed=false){
+	for(int i=0; i<n; i++){
+		for(int j=0; j<n; j++){
+			double s = 0;
+			for(int k=0; k<n; k++){
+				for(int l=0; l<n; l++){
+					s += (transposed ? J[k*n+i] * J[l*n+j] : J[i*n+k] * J[j*n+l]) * A[k*n+l];
+				}
+			}
+			result[i*n+j] = s;
+		}
+	}
+}
+
+/**
+ * The weight $L^T L$ of a measurement whitened with the Cholesky factor
+ * L of information.
+ */
+template<int DOF>
+void weight(const double *information, double *W){
+	CholeskyCovariance<DOF> chol(information, CholeskyMode::CHOLESKY_FULL);
+	const double *L = chol.chol;
+	for(int i=0; i<DOF; i++){
+		for(int j=0; j<DOF; j++){
+			double s = 0;
+			for(int k=std::max(i, j); k<DOF; k++){
+				s += L[k*(k+1)/2+i] * L[k*(k+1)/2+j];
+			}
+			W[i*DOF+j] = s;
+		}
+	}
+}
+
+/**
+ * The information matrix whose Cholesky factor whitens with the weight W,
+ * i.e. the inverse of weight(). With the indices reversed, $W = C C^T$
+ * gives the lower triangular $L$ with $L^T L = W$.
+ */
+template<int DOF>
+void whitening(const double *W, double *information){
+	double reversed[DOF*DOF];
+	for(int i=0; i<DOF; i++){
+		for(int j=0; j<DOF; j++){
+			reversed[i*DOF+j] = W[(DOF-1-i)*DOF + DOF-1-j];
+		}
+	}
+	CholeskyCovariance<DOF> chol(reversed, CholeskyMode::CHOLESKY_FULL);
+	const double *C = chol.chol;
+	// L(i,k) = C(DOF-1-k, DOF-1-i), information = L L^T
+	for(int i=0; i<DOF; i++){
+		for(int j=0; j<DOF; j++){
+			double s = 0;
+			for(int k=0; k<=std::min(i, j); k++){
+				int r = DOF-1-k;
+				s += C[r*(r+1)/2 + DOF-1-i] * C[r*(r+1)/2 + DOF-1-j];
+			}
+			information[i*DOF+j] = s;
+		}
+	}
+}
+
+/**
+ * Numerical Jacobian of $f(x \boxplus \epsilon) \boxminus reference$ with
+ * respect to $\epsilon$, J is row major. f maps Pose_T to Pose_T.
+ */
+template<typename Pose_T, typename F>
+void jacobian(const F &f, const Pose_T &x, const Pose_T &reference, double *J){
+	enum {DOF = Pose_T::DOF};
+	const double d = 1e6;
+	for(int k=0; k<DOF; k++){
+		double eps[DOF], plus[DOF], minus[DOF];
+		std::fill_n(eps, (int)DOF, 0.0);
+		eps[k] = 1/d;
+		Pose_T p = x, m = x;
+		p.add(eps, 1);
+		m.add(eps, -1);
+		f(p).sub(plus, reference);
+		f(m).sub(minus, reference);
+		for(int r=0; r<DOF; r++){
+			J[r*DOF+k] = 0.5*d*(plus[r] - minus[r]);
+		}
+	}
+}
+
+/**
+ * Functions of one pose for jacobian():
+ * Inverse is $p^{-1}$, ComposeLeft is $p \oplus other$,
+ * ComposeRight is $other \oplus p$, LocalFrom is $p \ominus other$,
+ * i.e. other seen from p, and LocalTo is p seen from other.
+ */
+template<typename Pose_T>
+struct Inverse {
+	Pose_T operator()(const Pose_T &p) const { return p.world2Local(Pose_T()); }
+};
+
+template<typename Pose_T>
+struct ComposeLeft {
+	Pose_T other;
+	ComposeLeft(const Pose_T &other) : other(other) {}
+	Pose_T operator()(const Pose_T &p) const { return p.local2World(other); }
+};
+
+template<typename Pose_T>
+struct ComposeRight {
+	Pose_T other;
+	ComposeRight(const Pose_T &other) : other(other) {}
+	Pose_T operator()(const Pose_T &p) const { return other.local2World(p); }
+};
+
+template<typename Pose_T>
+struct LocalFrom {
+	Pose_T other;
+	LocalFrom(const Pose_T &other) : other(other) {}
+	Pose_T operator()(const Pose_T &p) const { return p.world2Local(other); }
+};
+
+template<typename Pose_T>
+struct LocalTo {
+	Pose_T other;
+	LocalTo(const Pose_T &other) : other(other) {}
+	Pose_T operator()(const Pose_T &p) const { return other.world2Local(p); }
+};
+
+}  // namespace PoseGraph
+
+
+template<typename Pose_T>
+void PoseGraphEdge<Pose_T>::reverse(PoseGraphEdge &result) const {
+	result.from = to;
+	result.to = from;
+	result.delta = delta.world2Local(Pose_T());
+	// J maps a change of result.delta to a change of delta, W' = J^T W J:
+	double J[DOF*DOF], W[DOF*DOF], reversed[DOF*DOF];
+	PoseGraph::jacobian(PoseGraph::Inverse<Pose_T>(), result.delta, delta, J);
+	PoseGraph::weight<DOF>(information, W);
+	PoseGraph::transform(J, W, reversed, DOF, true);
+	PoseGraph::whitening<DOF>(reversed, result.information);
+}
+
+template<typename Pose_T>
+void PoseGraphEdge<Pose_T>::compose(const PoseGraphEdge &first, const PoseGraphEdge &second,
+		PoseGraphEdge &result)
+{
+	Pose_T delta = first.delta.local2World(second.delta);
+	// sum of J W^{-1} J^T over both edges:
+	double J[DOF*DOF], cov[DOF*DOF], part[DOF*DOF], sum[DOF*DOF];
+	PoseGraph::jacobian(PoseGraph::ComposeLeft<Pose_T>(second.delta), first.delta, delta, J);
+	PoseGraph::weight<DOF>(first.information, cov);
+	PoseGraph::invert(cov, DOF);
+	PoseGraph::transform(J, cov, sum, DOF);
+	PoseGraph::jacobian(PoseGraph::ComposeRight<Pose_T>(first.delta), second.delta, delta, J);
+	PoseGraph::weight<DOF>(second.information, cov);
+	PoseGraph::invert(cov, DOF);
+	PoseGraph::transform(J, cov, part, DOF);
+	for(int k=0; k<DOF*DOF; k++) sum[k] += part[k];
+	PoseGraph::invert(sum, DOF);
+	result.from = first.from;
+	result.to = second.to;
+	result.delta = delta;
+	PoseGraph::whitening<DOF>(sum, result.information);
+}
+
+template<typename Pose_T>
+void PoseGraphEdge<Pose_T>::fuse(const PoseGraphEdge &a, const PoseGraphEdge &b, PoseGraphEdge &result){
+	double Wa[DOF*DOF], Wb[DOF*DOF], W[DOF*DOF], cov[DOF*DOF], diff[DOF], step[DOF];
+	PoseGraph::weight<DOF>(a.information, Wa);
+	PoseGraph::weight<DOF>(b.information, Wb);
+	for(int k=0; k<DOF*DOF; k++) W[k] = Wa[k] + Wb[k];
+	std::copy(W, W + DOF*DOF, cov);
+	PoseGraph::invert(cov, DOF);
+	b.delta.sub(diff, a.delta);
+	// step = (W_a + W_b)^{-1} W_b diff
+	for(int i=0; i<DOF; i++){
+		step[i] = 0;
+		for(int j=0; j<DOF; j++){
+			for(int k=0; k<DOF; k++){
+				step[i] += cov[i*DOF+j] * Wb[j*DOF+k] * diff[k];
+			}
+		}
+	}
+	result.from = a.from;
+	result.to = a.to;
+	result.delta = a.delta;
+	result.delta.add(step, 1);
+	PoseGraph::whitening<DOF>(W, result.information);
+}
+
+}  // namespace SLOM
+
+#endif /*POSEGRAPH_H_*/
@@ -0,0 +1,111 @@
+#ifndef SPANNINGTREE_H_
+#define SPANNINGTREE_H_
+
+#include "PoseGraph.h"
+
+#include <map>
+#include <queue>
+#include <vector>
+#include <functional>
+
+namespace SLOM {
+
+/**
+ * Initial values for pose graphs. The relative pose measurements are
+ * collected as edges, then the tree of the least uncertain paths from the
+ * root poses to all other poses is built (Dijkstra on the accumulated
+ * uncertainty of the edges) and the relative poses are composed along it.
+ *
+ * Poses and the direction of edges are as described for PoseGraphEdge,
+ * the information is replaced by a scalar uncertainty.
+ */
+template<typename Pose_T>
+class SpanningTree
+{
+	struct Edge {
+		int from, to;
+		Pose_T delta;
+		double uncertainty;
+	};
+	std::vector<Edge> edges;
+	std::map<int, std::vector<int> > incident; // edges of each pose
+	std::map<int, Pose_T> roots;
+
+	typedef std::pair<double, int> Entry; // accumulated uncertainty, pose
+
+public:
+	/**
+	 * Adds the measurement $from.world2Local(to) \approx delta$.
+	 * uncertainty has to be positive, e.g. the trace of the covariance.
+	 */
+	void addEdge(int from, int to, const Pose_T &delta, double uncertainty=1){
+		Edge e = {from, to, delta, uncertainty};
+		incident[from].push_back(edges.size());
+		incident[to].push_back(edges.size());
+		edges.push_back(e);
+	}
+
+	/**
+	 * Poses with known values, e.g. the fixed first pose.
+	 * If there is no root, the smallest id is the root at the origin.
+	 */
+	void addRoot(int id, const Pose_T &pose=Pose_T()){
+		roots[id] = pose;
+	}
+
+	/**
+	 * Stores the pose of every vertex in poses. Components not connected
+	 * to a root get their smallest id as root at the origin.
+	 * Returns the number of components.
+	 */
+	int compose(std::map<int, Pose_T> &poses) const {
+		poses.clear();
+		std::map<int, double> cost;
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+		for(typename std::map<int, Pose_T>::const_iterator r = roots.begin(); r != roots.end(); r++){
+			poses[r->first] = r->second;
+			cost[r->first] = 0;
+			queue.push(Entry(0, r->first));
+		}
+		int components = roots.empty() ? 0 : 1;
+		std::map<int, std::vector<int> >::const_iterator next = incident.begin();
+		for(;;){
+			if(queue.empty()){
+				// start the next component at its smallest unreached id:
+				while(next != incident.end() && poses.count(next->first)) next++;
+				if(next == incident.end()) break;
+				poses[next->first] = Pose_T();
+				cost[next->first] = 0;
+				queue.push(Entry(0, next->first));
+				components++;
+			}
+			Entry top = queue.top();
+			queue.pop();
+			int id = top.second;
+			if(top.first > cost[id]) continue; // outdated entry
+			std::map<int, std::vector<int> >::const_iterator inc = incident.find(id);
+			if(inc == incident.end()) continue;
+			const Pose_T &pose = poses[id];
+			for(size_t k=0; k<inc->second.size(); k++){
+				const Edge &e = edges[inc->second[k]];
+				int other = e.from == id ? e.to : e.from;
+				double c = top.first + e.uncertainty;
+				std::map<int, double>::iterator old = cost.find(other);
+				if(old != cost.end() && old->second <= c) continue;
+				cost[other] = c;
+				if(e.from == id){
+					poses[other] = pose.local2World(e.delta);
+				} else {
+					// compose with the inverse of delta:
+					poses[other] = pose.local2World(PoseGraph::Inverse<Pose_T>()(e.delta));
+				}
+				queue.push(Entry(c, other));
+			}
+		}
+		return components;
+	}
+};
+
+}  // namespace SLOM
+
+#endif /*SPANNINGTREE_H_*/
@@ -0,0 +1,102 @@
+#ifndef STEPSTATS_H_
+#define STEPSTATS_H_
+
+#include <algorithm>
+
+#include <sys/time.h>
+
+/**
+ * Statements only compiled if statistics are enabled.
+ * Define SLOM_NO_STATS to compile out all timings and counters.
+ */
+#ifndef SLOM_NO_STATS
+#  define SLOM_STAT(stmt) stmt
+#else
+#  define SLOM_STAT(stmt)
+#endif
+
+namespace SLOM {
+
+/**
+ * Timings and counters of the Estimator, see Estimator::getStats().
+ * Times are wall-clock seconds.
+ */
+struct StepStats {
+	enum Phase {
+		Jacobian,      // numerical Jacobian
+		Damping,       // damping term of Levenberg(-Marquardt)
+		Assembly,      // JtJ and J^T r
+		Symbolic,      // symbolic analysis, done by initialize()
+		Factorization, // numeric factorization (with the solves for Submaps, PCG and speculative damping)
+		Solve,         // triangular solves
+		Evaluation,    // evaluation of all measurements
+		NumPhases
+	};
+	double time[NumPhases];
+	int steps;        // calls of optimizeStep()
+	int evaluations;  // calls of evaluate()
+	long nnzJ;        // non-zeros of the Jacobian, including the damping term
+	long nnzL;        // non-zeros of the last factor
+	long bytes;       // memory of the matrices, factors and vectors of the workspace
+
+	StepStats() { clear(); }
+
+	void clear() {
+		std::fill_n(time, (int)NumPhases, 0.0);
+		steps = evaluations = 0;
+		nnzJ = nnzL = bytes = 0;
+	}
+
+	/**
+	 * Adds the times and counts of s, takes the sizes from s.
+	 */
+	void add(const StepStats &s) {
+		for(int k=0; k<NumPhases; k++) time[k] += s.time[k];
+		steps += s.steps;
+		evaluations += s.evaluations;
+		nnzJ = s.nnzJ; nnzL = s.nnzL; bytes = s.bytes;
+	}
+
+	double totalTime() const {
+		double sum = 0;
+		for(int k=0; k<NumPhases; k++) sum += time[k];
+		return sum;
+	}
+
+	static const char* phaseName(int phase) {
+		static const char* names[NumPhases] = {"jacobian", "damping", "assembly",
+				"symbolic", "factorization", "solve", "evaluation"};
+		return phase >= 0 && phase < NumPhases ? names[phase] : "unknown";
+	}
+};
+
+
+/**
+ * Adds the time between construction and destruction to target.
+ * Does nothing if SLOM_NO_STATS is defined.
+ */
+class PhaseTimer {
+#ifndef SLOM_NO_STATS
+	double &target;
+	struct timeval start;
+public:
+	explicit PhaseTimer(double &target) : target(target) {
+		gettimeofday(&start, 0);
+	}
+	~PhaseTimer() {
+		struct timeval end;
+		gettimeofday(&end, 0);
+		target += (end.tv_sec-start.tv_sec) + 1e-6*(end.tv_usec-start.tv_usec);
+	}
+#else
+public:
+	explicit PhaseTimer(double &) {}
+#endif
+private:
+	PhaseTimer(const PhaseTimer&);
+	PhaseTimer& operator=(const PhaseTimer&);
+};
+
+}  // namespace SLOM
+
+#endif /*STEPSTATS_H_*/
@@ -0,0 +1,197 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for pthread_setaffinity_np
+#endif
+
+#include "ThreadPool.h"
+
+#include <cassert>
+
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace SLOM {
+
+namespace {
+// The pool and index of the current thread, if it is a worker:
+__thread const ThreadPool *currentPool = 0;
+__thread int currentIndex = 0;
+}
+
+
+ThreadPool::ThreadPool(int numWorkers, bool pinThreads) :
+	numWorkers(0), queued(0), stop(false), nextQueue(0)
+{
+	pthread_mutex_init(&lock, 0);
+	pthread_cond_init(&wake, 0);
+	start(numWorkers, pinThreads);
+}
+
+ThreadPool::~ThreadPool(){
+	shutdown();
+	pthread_cond_destroy(&wake);
+	pthread_mutex_destroy(&lock);
+}
+
+
+void ThreadPool::resize(int numWorkers, bool pinThreads){
+	shutdown();
+	start(numWorkers, pinThreads);
+}
+
+
+void ThreadPool::start(int workers, bool pinThreads){
+	numWorkers = workers > 0 ? workers : 0;
+	stop = false;
+	nextQueue = 0;
+	queues.resize(numWorkers);
+	for(int k=0; k<numWorkers; k++){
+		queues[k] = new Queue;
+		pthread_mutex_init(&queues[k]->lock, 0);
+	}
+	args.resize(numWorkers);
+	threads.resize(numWorkers);
+	for(int k=0; k<numWorkers; k++){
+		WorkerArg arg = {this, k, pinThreads};
+		args[k] = arg;
+		int err = pthread_create(&threads[k], 0, workerMain, &args[k]);
+		assert(err == 0); (void) err;
+	}
+}
+
+
+void ThreadPool::shutdown(){
+	pthread_mutex_lock(&lock);
+	stop = true;
+	pthread_cond_broadcast(&wake);
+	pthread_mutex_unlock(&lock);
+	for(int k=0; k<numWorkers; k++){
+		pthread_join(threads[k], 0);
+	}
+	for(int k=0; k<numWorkers; k++){
+		pthread_mutex_destroy(&queues[k]->lock);
+		delete queues[k];
+	}
+	queues.clear();
+	args.clear();
+	threads.clear();
+	numWorkers = 0;
+}
+
+
+int ThreadPool::threadIndex() const {
+	return currentPool == this ? currentIndex : numWorkers;
+}
+
+
+void* ThreadPool::workerMain(void *arg_){
+	WorkerArg &arg = *static_cast<WorkerArg*>(arg_);
+	ThreadPool &pool = *arg.pool;
+	currentPool = &pool;
+	currentIndex = arg.index;
+#ifdef __linux__
+	if(arg.pin){
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if(cpus > 0){
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(arg.index % cpus, &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		}
+	}
+#endif
+	for(;;){
+		if(pool.runOne(arg.index)) continue;
+		pthread_mutex_lock(&pool.lock);
+		while(pool.queued == 0 && !pool.stop){
+			pthread_cond_wait(&pool.wake, &pool.lock);
+		}
+		bool done = pool.stop && pool.queued == 0;
+		pthread_mutex_unlock(&pool.lock);
+		if(done) break;
+	}
+	return 0;
+}
+
+
+void ThreadPool::submit(Task *task, Group &group){
+	__atomic_add_fetch(&group.pending, 1, __ATOMIC_ACQ_REL);
+	if(numWorkers == 0){
+		task->run();
+		finish(group);
+		return;
+	}
+	int self = threadIndex();
+	int q = self < numWorkers ? self : (nextQueue++ % numWorkers);
+	Entry entry = {task, &group};
+	pthread_mutex_lock(&queues[q]->lock);
+	queues[q]->entries.push_back(entry);
+	pthread_mutex_unlock(&queues[q]->lock);
+
+	pthread_mutex_lock(&lock);
+	queued++;
+	pthread_cond_broadcast(&wake);
+	pthread_mutex_unlock(&lock);
+}
+
+
+bool ThreadPool::take(int self, Entry &entry){
+	// own queue first (newest task), then steal from the others (oldest task):
+	for(int k=0; k<numWorkers; k++){
+		int q = (self + k) % numWorkers;
+		Queue &queue = *queues[q];
+		pthread_mutex_lock(&queue.lock);
+		bool found = !queue.entries.empty();
+		if(found){
+			if(q == self){
+				entry = queue.entries.back();
+				queue.entries.pop_back();
+			} else {
+				entry = queue.entries.front();
+				queue.entries.pop_front();
+			}
+		}
+		pthread_mutex_unlock(&queue.lock);
+		if(found){
+			pthread_mutex_lock(&lock);
+			queued--;
+			pthread_mutex_unlock(&lock);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+bool ThreadPool::runOne(int self){
+	Entry entry;
+	if(!take(self, entry)) return false;
+	entry.task->run();
+	finish(*entry.group);
+	return true;
+}
+
+
+void ThreadPool::finish(Group &group){
+	if(__atomic_sub_fetch(&group.pending, 1, __ATOMIC_ACQ_REL) == 0){
+		pthread_mutex_lock(&lock);
+		pthread_cond_broadcast(&wake);
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+
+void ThreadPool::wait(Group &group){
+	int self = threadIndex();
+	while(__atomic_load_n(&group.pending, __ATOMIC_ACQUIRE) > 0){
+		if(runOne(self < numWorkers ? self : 0)) continue;
+		pthread_mutex_lock(&lock);
+		while(queued == 0 && __atomic_load_n(&group.pending, __ATOMIC_ACQUIRE) > 0){
+			pthread_cond_wait(&wake, &lock);
+		}
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+}  // namespace SLOM
@@ -0,0 +1,150 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <pthread.h>
+
+namespace SLOM {
+
+/**
+ * A work-stealing thread pool.
+ * Each worker has its own task queue. Workers take tasks from the back of
+ * their own queue and steal from the front of other queues when theirs is
+ * empty. A thread waiting for a Group runs queued tasks meanwhile.
+ * With zero workers every task is run inline by the submitting thread.
+ *
+ * Only one thread outside of the pool may submit tasks at a time.
+ */
+class ThreadPool
+{
+public:
+	struct Task {
+		virtual ~Task() {}
+		virtual void run() = 0;
+	};
+
+	/**
+	 * A set of tasks which can be waited for.
+	 */
+	class Group {
+		friend class ThreadPool;
+		int pending;
+	public:
+		Group() : pending(0) {}
+	};
+
+	/**
+	 * Starts numWorkers threads. If pinThreads is set, worker k is bound
+	 * to CPU k (modulo the number of CPUs).
+	 */
+	ThreadPool(int numWorkers=0, bool pinThreads=false);
+	~ThreadPool();
+
+	/**
+	 * Replaces the workers by numWorkers new ones, the pool object stays
+	 * the same. Must not be called while tasks are queued or running.
+	 */
+	void resize(int numWorkers, bool pinThreads=false);
+
+	int getNumWorkers() const { return numWorkers; }
+
+	/**
+	 * Number of threads which can run tasks concurrently,
+	 * i.e. the workers plus the waiting thread.
+	 */
+	int getNumThreads() const { return numWorkers+1; }
+
+	/**
+	 * Index of the calling thread in [0, getNumThreads()).
+	 * Workers have indices [0, numWorkers), every other thread gets numWorkers.
+	 */
+	int threadIndex() const;
+
+	/**
+	 * Queues task as part of group. The task is not copied and not deleted.
+	 */
+	void submit(Task *task, Group &group);
+
+	/**
+	 * Waits until all tasks of group are done, running queued tasks meanwhile.
+	 */
+	void wait(Group &group);
+
+	/**
+	 * Calls body(k) for all k in [0,n), in tasks of grain consecutive indices,
+	 * and waits for them to finish.
+	 */
+	template<typename Body>
+	void parallelFor(int n, Body &body, int grain=1){
+		if(grain < 1) grain = 1;
+		if(numWorkers == 0 || n <= grain){
+			for(int k=0; k<n; k++) body(k);
+			return;
+		}
+		int numTasks = (n + grain - 1) / grain;
+		std::vector<RangeTask<Body> > tasks(numTasks);
+		Group group;
+		for(int t=0; t<numTasks; t++){
+			tasks[t].body = &body;
+			tasks[t].begin = t*grain;
+			tasks[t].end = std::min(n, (t+1)*grain);
+			submit(&tasks[t], group);
+		}
+		wait(group);
+	}
+
+private:
+	template<typename Body>
+	struct RangeTask : public Task {
+		Body *body;
+		int begin, end;
+		void run() {
+			for(int k=begin; k<end; k++) (*body)(k);
+		}
+	};
+
+	struct Entry {
+		Task *task;
+		Group *group;
+	};
+
+	struct Queue {
+		pthread_mutex_t lock;
+		std::deque<Entry> entries;
+	};
+
+	int numWorkers;
+	std::vector<pthread_t> threads;
+	std::vector<Queue*> queues;
+
+	pthread_mutex_t lock;  // protects queued and stop
+	pthread_cond_t wake;   // signaled on new tasks and finished groups
+	int queued;            // number of tasks in all queues
+	bool stop;
+	int nextQueue;         // round robin for submissions from outside
+
+	struct WorkerArg {
+		ThreadPool *pool;
+		int index;
+		bool pin;
+	};
+	std::vector<WorkerArg> args;
+
+	static void* workerMain(void *arg);
+	void start(int workers, bool pinThreads);
+	void shutdown();
+	bool take(int self, Entry &entry);
+	bool runOne(int self);
+	void finish(Group &group);
+
+	// not copyable:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+};
+
+}  // namespace SLOM
+
+#endif /*THREADPOOL_H_*/
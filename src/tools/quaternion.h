@@ -98,7 +98,7 @@ struct Quaternion{
 		return *this;
 	}
 	
-	double norm(){
+	double norm() const {
 		return sqrt(w*w + x*x + y*y + z*z);
 	}
 	
@@ -106,7 +106,7 @@ struct Quaternion{
 		return (*this)*=1/norm();
 	}
 	
-	void toScaledAxis(double* res){
+	void toScaledAxis(double* res) const {
 		double nv = sqrt(x*x + y*y + z*z);
 		if( nv < 1e-12) nv = 1e-12;
 		// BUGFIX 2009-11-30: q and -q are represent the same rotation 
@@ -27,6 +27,10 @@ public:
 		lastIdx += m->getDim();
 	}
 	int getDim() const { return lastIdx; }
+	void clear(){
+		Container::clear();
+		lastIdx = 0;
+	}
 	
 	
 	
@@ -12,7 +12,7 @@ class IMeasurement;
 
 
 struct IRVWrapper : private std::deque<const IMeasurement*>{
-	IRVWrapper(bool optimize=true) : idx(-1), optimize(optimize), registered(false) {}
+	IRVWrapper(bool optimize=true) : idx(-1), optimize(optimize), registered(false), change(0) {}
 	virtual ~IRVWrapper() {}
 	/**
 	 * Gets the DOF of the enclosed RandomVariable.
@@ -30,6 +30,15 @@ struct IRVWrapper : private std::deque<const IMeasurement*>{
 	 * Restores var from backup.
 	 */
 	virtual void restore() = 0;
+	/**
+	 * Writes the getDOF() coordinates of var relative to a default
+	 * constructed RV to coords, for checkpoints.
+	 */
+	virtual void save(double *coords) const = 0;
+	/**
+	 * Sets var and backup from the coordinates written by save().
+	 */
+	virtual void load(const double *coords) = 0;
 	/**
 	 * Registers the passed IMeasurement.
 	 */
@@ -58,6 +67,10 @@ private:
 	 */
 	bool optimize;
 	bool registered;
+	/**
+	 * Infinity norm of the last accepted update, see Estimator::selectChanged().
+	 */
+	double change;
 };
 
 
@@ -68,6 +81,8 @@ private:
  * - An enum DOF which gives its degrees of freedom,
  * - A method add, which adds a scaled vector to the RV.
  * - Being CopyConstructable and Assignable. 
+ * - For checkpoints, a method sub, which returns the vector to add to 
+ *   another RV to obtain this one, like Manifold::sub().
  */
 template<typename RV>
 class RVWrapper : public IRVWrapper{
@@ -83,6 +98,12 @@ public:
 	}
 	void store() {backup = var;}
 	void restore() {var = backup;}
+	void save(double *coords) const {var.sub(coords, RV());}
+	void load(const double *coords) {
+		RV v;
+		v.add(coords);
+		var = backup = v;
+	}
 
 	// Getters and setters:
 	const RV& operator*() const { return var; }
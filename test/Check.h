@@ -0,0 +1,32 @@
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <iostream>
+#include <cmath>
+
+/**
+ * Minimal checks for the test programs: a failed CHECK is reported with
+ * its location and counted, main() returns the number of failures.
+ */
+
+static int checkFailures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if(!(cond)){ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+			checkFailures++; \
+		} \
+	} while(false)
+
+#define CHECK_CLOSE(a, b, tol) \
+	do { \
+		double checkA = (a), checkB = (b); \
+		if(!(std::abs(checkA - checkB) <= (tol))){ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_CLOSE(" #a ", " #b ") failed: " \
+			          << checkA << " != " << checkB << std::endl; \
+			checkFailures++; \
+		} \
+	} while(false)
+
+#endif /*CHECK_H_*/
@@ -0,0 +1,187 @@
+#ifndef TOYGRAPH_H_
+#define TOYGRAPH_H_
+
+#include <Estimator.h>
+#include <tools/MakePose.h>
+#include <tools/NoiseModel.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+
+/**
+ * A small 2D pose graph for the tests, the same on every run.
+ * The poses drive around a square several times, with odometry between
+ * consecutive poses and loop closures to the same place on the previous
+ * lap. The measurements have a fixed pseudo-random error, so the optimum
+ * is not the ground truth, and the poses start from dead reckoning.
+ */
+
+MAKE_POSE2D(Pose, pos, orientation, )
+
+BUILD_MEASUREMENT(Odo, 3, ((Pose, t0)) ((Pose, t1)),
+		((Pose_T, odo)) ((SLOM::SharedCovariance<3>, cov)) )
+inline double* Odo::eval(double ret[3]) const
+{
+	Pose_T diff = t0->world2Local(*t1);
+	diff.sub(ret, odo);
+	cov.apply(ret);
+	return ret+3;
+}
+
+
+struct ToyGraph {
+	/**
+	 * The measurement $from.world2Local(to) \approx delta$, information
+	 * is the full 3x3 matrix in row major order.
+	 */
+	struct Edge {
+		int from, to;
+		Pose_T delta;
+		double information[9];
+	};
+
+	std::vector<Pose_T> initial; // dead reckoning of the odometry
+	std::vector<Edge> edges;
+
+	/**
+	 * laps times around a square with sides of side steps.
+	 * If extraOdometry is set, each odometry edge is measured twice.
+	 */
+	ToyGraph(int side=3, int laps=3, bool extraOdometry=false) : seed(12345) {
+		int lap = 4*side;
+		int numPoses = laps*lap + 1;
+		std::vector<Pose_T> truth(numPoses);
+		for(int k=1; k<numPoses; k++){
+			double step[3] = {1, 0, (k % side == 0) ? M_PI/2 : 0};
+			truth[k] = truth[k-1].local2World(Pose_T(step, step[2]));
+		}
+		initial.push_back(truth[0]);
+		for(int k=1; k<numPoses; k++){
+			const Edge &odo = addEdge(truth, k-1, k);
+			initial.push_back(initial.back().local2World(odo.delta));
+			if(extraOdometry) addEdge(truth, k-1, k);
+			if(k >= lap) addEdge(truth, k-lap, k);
+		}
+	}
+
+	/**
+	 * The poses and edges remaining of a graph, e.g. in a Sparsifier,
+	 * numbered consecutively in the order of their ids. The poses start
+	 * from start[id].
+	 */
+	template<class Edges>
+	ToyGraph(const std::vector<Pose_T> &start, const std::map<int, Pose_T> &poses, const Edges &remaining) : seed(12345) {
+		std::map<int, int> index;
+		for(typename std::map<int, Pose_T>::const_iterator it = poses.begin(); it != poses.end(); ++it){
+			index[it->first] = initial.size();
+			initial.push_back(start[it->first]);
+		}
+		for(size_t k=0; k<remaining.size(); k++){
+			Edge e;
+			e.from = index[remaining[k].from];
+			e.to = index[remaining[k].to];
+			e.delta = remaining[k].delta;
+			std::copy(remaining[k].information, remaining[k].information+9, e.information);
+			edges.push_back(e);
+		}
+	}
+
+	int size() const {
+		return initial.size();
+	}
+
+private:
+	unsigned long seed;
+
+	/**
+	 * Uniform in [-1, 1), from a linear congruential generator.
+	 */
+	double noise(){
+		seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+		return seed / double(0x40000000UL) - 1;
+	}
+
+	const Edge& addEdge(const std::vector<Pose_T> &truth, int from, int to){
+		Edge e;
+		e.from = from;
+		e.to = to;
+		double error[3] = {0.05*noise(), 0.05*noise(), 0.02*noise()};
+		e.delta = truth[from].world2Local(truth[to]);
+		e.delta.add(error);
+		const double information[9] = {400, 0, 0,  0, 400, 0,  0, 0, 2500};
+		std::copy(information, information+9, e.information);
+		edges.push_back(e);
+		return edges.back();
+	}
+};
+
+
+/**
+ * The poses and measurements of a ToyGraph inserted into an estimator,
+ * pose 0 is fixed.
+ */
+struct ToyProblem {
+	std::deque<Pose> poses;
+	std::deque<Odo> odo;
+
+	ToyProblem(SLOM::Estimator &e, const ToyGraph &g){
+		for(int k=0; k<g.size(); k++){
+			poses.push_back(Pose(g.initial[k], k != 0));
+			e.insertRV(&poses.back());
+		}
+		for(size_t k=0; k<g.edges.size(); k++){
+			const ToyGraph::Edge &edge = g.edges[k];
+			odo.push_back(Odo(poses[edge.from], poses[edge.to], edge.delta,
+					SLOM::CholeskyCovariance<3>(edge.information, SLOM::CholeskyMode::CHOLESKY_FULL)));
+			e.insertMeasurement(&odo.back());
+		}
+	}
+
+	void getPoses(std::vector<Pose_T> &result) const {
+		result.clear();
+		for(size_t k=0; k<poses.size(); k++) result.push_back(*poses[k]);
+	}
+
+	/**
+	 * Largest difference of any pose coordinate to other.
+	 */
+	double maxDifference(const std::vector<Pose_T> &other) const;
+};
+
+
+/**
+ * Largest difference of any coordinate of the poses a and b.
+ */
+inline double maxDifference(const std::vector<Pose_T> &a, const std::vector<Pose_T> &b){
+	double result = 0;
+	for(size_t k=0; k<a.size(); k++){
+		double d[3];
+		a[k].sub(d, b[k]);
+		for(int i=0; i<3; i++) result = std::max(result, std::abs(d[i]));
+	}
+	return result;
+}
+
+inline double ToyProblem::maxDifference(const std::vector<Pose_T> &other) const {
+	std::vector<Pose_T> current;
+	getPoses(current);
+	return ::maxDifference(current, other);
+}
+
+
+/**
+ * The optimum of g, found with Gauss-Newton and the Cholesky solver.
+ */
+inline void solveReference(const ToyGraph &g, std::vector<Pose_T> &result){
+	SLOM::Estimator e(SLOM::Estimator::Cholesky, SLOM::Estimator::GaussNewton);
+	ToyProblem problem(e, g);
+	e.initialize();
+	e.optimize(50, SLOM::Estimator::Tolerances(1e-12));
+	problem.getPoses(result);
+}
+
+#endif /*TOYGRAPH_H_*/
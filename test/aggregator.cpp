@@ -0,0 +1,72 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <Aggregator.h>
+
+#include <map>
+#include <iostream>
+
+using namespace SLOM;
+
+/**
+ * Fusing parallel edges and pre-integrating odometry chains has to keep the
+ * optimum up to linearization, for the remaining poses as well as for the
+ * poses recovered along the chains.
+ */
+
+static const double TOLERANCE = 2e-3;
+
+int main(){
+	// odometry measured twice, loops closed only at the corners of the square:
+	ToyGraph full(3, 3, true), g;
+	g.initial = full.initial;
+	g.edges.clear();
+	const double information[9] = {400, 150, 100,  150, 300, 80,  100, 80, 2500};
+	int parallel = 0;
+	for(size_t k=0; k<full.edges.size(); k++){
+		ToyGraph::Edge e = full.edges[k];
+		bool odometry = e.to == e.from + 1;
+		if(!odometry && e.to % 3 != 0) continue;
+		std::copy(information, information+9, e.information);
+		if(odometry && !g.edges.empty() && g.edges.back().from == e.from && g.edges.back().to == e.to){
+			parallel++;
+			std::swap(e.from, e.to); // also fuse reversed edges
+			e.delta = e.delta.world2Local(Pose_T());
+		}
+		g.edges.push_back(e);
+	}
+	std::vector<Pose_T> reference;
+	solveReference(g, reference);
+
+	Aggregator<Pose_T> aggregator;
+	for(int k=0; k<g.size(); k++) aggregator.addPose(k, g.initial[k], k == 0);
+	for(size_t k=0; k<g.edges.size(); k++){
+		const ToyGraph::Edge &e = g.edges[k];
+		aggregator.addEdge(e.from, e.to, e.delta, e.information);
+	}
+	CHECK(aggregator.mergeParallel() == parallel);
+	int integrated = aggregator.integrateChains();
+	CHECK(integrated > 0);
+	CHECK((int)aggregator.getPoses().size() + integrated == g.size());
+
+	const std::map<int, Pose_T> &poses = aggregator.getPoses();
+	ToyGraph aggregated(g.initial, poses, aggregator.getEdges());
+	std::vector<Pose_T> optimized;
+	solveReference(aggregated, optimized);
+
+	std::map<int, Pose_T> result;
+	int k = 0;
+	for(std::map<int, Pose_T>::const_iterator it = poses.begin(); it != poses.end(); ++it){
+		result[it->first] = optimized[k++];
+	}
+	aggregator.recover(result);
+	CHECK((int)result.size() == g.size());
+	std::vector<Pose_T> recovered;
+	for(std::map<int, Pose_T>::const_iterator it = result.begin(); it != result.end(); ++it){
+		recovered.push_back(it->second);
+	}
+	CHECK(maxDifference(recovered, reference) < TOLERANCE);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
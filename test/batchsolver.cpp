@@ -0,0 +1,84 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <BatchSolver.h>
+
+#include <deque>
+#include <vector>
+#include <iostream>
+
+using namespace SLOM;
+
+/**
+ * Solving problems in a batch has to give the same result as solving each
+ * one with its own Estimator, also when the Estimators of the batch reuse
+ * their workspace for problems of the same shape.
+ */
+
+static const int MAX_ITERATIONS = 50;
+static const double MIN_GAIN = 1e-12;
+
+/**
+ * The poses and measurements of a ToyGraph for the BatchSolver.
+ */
+struct BatchProblem {
+	std::deque<Pose> poses;
+	std::deque<Odo> odo;
+
+	void insert(const ToyGraph &g, BatchSolver::Problem &problem){
+		for(int k=0; k<g.size(); k++){
+			poses.push_back(Pose(g.initial[k], k != 0));
+			problem.variables.push_back(&poses.back());
+		}
+		for(size_t k=0; k<g.edges.size(); k++){
+			const ToyGraph::Edge &edge = g.edges[k];
+			odo.push_back(Odo(poses[edge.from], poses[edge.to], edge.delta,
+					CholeskyCovariance<3>(edge.information, CholeskyMode::CHOLESKY_FULL)));
+			problem.measurements.push_back(&odo.back());
+		}
+	}
+};
+
+static void testBatch(Estimator::Algorithm algorithm, int threads){
+	// problems of a few shapes, each shape several times:
+	std::vector<ToyGraph> graphs;
+	for(int k=0; k<12; k++) graphs.push_back(ToyGraph(2 + k%3, 2 + k%2));
+
+	std::vector<BatchProblem> data(graphs.size());
+	std::vector<BatchSolver::Problem> problems(graphs.size());
+	for(size_t k=0; k<graphs.size(); k++) data[k].insert(graphs[k], problems[k]);
+	BatchSolver batch(algorithm);
+	batch.setNumThreads(threads);
+	batch.setMaxIterations(MAX_ITERATIONS);
+	batch.setMinGain(MIN_GAIN);
+	std::vector<BatchSolver::Stats> stats;
+	batch.solve(problems, stats);
+	CHECK(stats.size() == graphs.size());
+
+	int reused = 0;
+	for(size_t k=0; k<graphs.size() && k<stats.size(); k++){
+		Estimator e(Estimator::Cholesky, algorithm);
+		ToyProblem single(e, graphs[k]);
+		e.initialize();
+		e.optimize(MAX_ITERATIONS, Estimator::Tolerances(MIN_GAIN));
+		std::vector<Pose_T> expected, result;
+		single.getPoses(expected);
+		for(size_t p=0; p<data[k].poses.size(); p++) result.push_back(*data[k].poses[p]);
+		CHECK(maxDifference(result, expected) == 0);
+		CHECK(stats[k].iterations == e.getIterations());
+		CHECK(stats[k].rss == std::abs(e.getLastRSS()));
+		CHECK(stats[k].converged);
+		reused += stats[k].reused;
+	}
+	// 12 problems of 6 shapes:
+	CHECK(reused >= int(graphs.size()) - 6*threads);
+}
+
+int main(){
+	testBatch(Estimator::GaussNewton, 1);
+	testBatch(Estimator::GaussNewton, 4);
+	testBatch(Estimator::LevenbergMarquardt, 4);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
@@ -0,0 +1,138 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <manifolds/SOn.h>
+
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <string>
+
+using namespace SLOM;
+
+/**
+ * A checkpoint restores the variables and the optimization state into a
+ * new Estimator with the same problem, which then continues to the same
+ * optimum. Problems of another shape are rejected without changes.
+ */
+
+static const double TOLERANCE = 1e-6;
+
+/**
+ * Variables are stored as manifold coordinates, this has to round trip
+ * also for rotations with cached matrices.
+ */
+static void testRotation(){
+	SO3 rotation;
+	double v[3] = {0.3, -1.2, 2.5};
+	rotation.add(v);
+	double rotated[3];
+	rotation.rotate(rotated, v); // fills the cache of the rotation matrix
+	RVWrapper<SO3> saved(rotation), loaded;
+	double coords[3];
+	saved.save(coords);
+	loaded.load(coords);
+	double d[3];
+	(*loaded).sub(d, rotation);
+	for(int i=0; i<3; i++) CHECK_CLOSE(d[i], 0, 1e-12);
+}
+
+static void testResume(const ToyGraph &g, const std::vector<Pose_T> &reference, bool withFactor){
+	std::stringstream checkpoint;
+	std::vector<Pose_T> saved;
+	{
+		Estimator e(Estimator::Cholesky, Estimator::LevenbergMarquardt);
+		ToyProblem problem(e, g);
+		e.initialize();
+		e.optimize(2, Estimator::Tolerances(1e-12));
+		CHECK(e.saveCheckpoint(checkpoint, withFactor));
+		problem.getPoses(saved);
+	}
+	CHECK(maxDifference(saved, reference) > TOLERANCE); // not done yet
+
+	Estimator e(Estimator::Cholesky, Estimator::LevenbergMarquardt);
+	ToyProblem problem(e, g);
+	CHECK(e.loadCheckpoint(checkpoint));
+	CHECK(problem.maxDifference(saved) < 1e-12);
+	e.optimize(100, Estimator::Tolerances(1e-12));
+	CHECK(problem.maxDifference(reference) < TOLERANCE);
+}
+
+static void testWrongShape(const ToyGraph &g){
+	std::stringstream checkpoint;
+	{
+		Estimator e(Estimator::Cholesky, Estimator::GaussNewton);
+		ToyProblem problem(e, g);
+		e.initialize();
+		CHECK(e.saveCheckpoint(checkpoint));
+	}
+	ToyGraph other(3, 2);
+	Estimator e(Estimator::Cholesky, Estimator::GaussNewton);
+	ToyProblem problem(e, other);
+	CHECK(!e.loadCheckpoint(checkpoint));
+	CHECK(problem.maxDifference(other.initial) == 0);
+}
+
+/**
+ * Loads checkpoint into a new Estimator for g and takes a step with what
+ * was loaded, returns whether it was accepted.
+ */
+static bool loadInto(const ToyGraph &g, const std::string &checkpoint){
+	Estimator e(Estimator::Cholesky, Estimator::LevenbergMarquardt);
+	ToyProblem problem(e, g);
+	std::istringstream in(checkpoint);
+	if(!e.loadCheckpoint(in)) return false;
+	e.optimize(1);
+	return true;
+}
+
+/**
+ * Corrupt checkpoints must be rejected instead of being used, this is
+ * meant to run under a memory checker as well.
+ */
+static void testCorrupt(const ToyGraph &g){
+	std::stringstream out;
+	{
+		Estimator e(Estimator::Cholesky, Estimator::LevenbergMarquardt);
+		ToyProblem problem(e, g);
+		e.initialize();
+		e.optimize(2, Estimator::Tolerances(1e-12));
+		CHECK(e.saveCheckpoint(out, true));
+	}
+	const std::string checkpoint = out.str();
+	CHECK(loadInto(g, checkpoint));
+
+	// truncated and padded with zeros:
+	std::string padded = checkpoint.substr(0, checkpoint.size()/2);
+	padded.resize(checkpoint.size(), '\0');
+	CHECK(!loadInto(g, padded));
+
+	// each int sized slot set to a huge and to a negative value in turn:
+	const int values[2] = {1 << 30, -5};
+	int rejected = 0, tries = 0;
+	for(size_t k=0; k+sizeof(int) <= checkpoint.size(); k += sizeof(int)){
+		for(int v=0; v<2; v++){
+			std::string corrupt = checkpoint;
+			std::memcpy(&corrupt[k], &values[v], sizeof(int));
+			rejected += !loadInto(g, corrupt);
+			tries++;
+		}
+	}
+	// most slots are values of doubles, which are only changed:
+	CHECK(rejected > tries/10);
+}
+
+int main(){
+	ToyGraph g;
+	std::vector<Pose_T> reference;
+	solveReference(g, reference);
+
+	testRotation();
+	testResume(g, reference, false);
+	testResume(g, reference, true);
+	testWrongShape(g);
+	testCorrupt(g);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
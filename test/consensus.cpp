@@ -0,0 +1,110 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <Consensus.h>
+
+#include <map>
+#include <set>
+#include <iostream>
+#include <unistd.h>
+
+using namespace SLOM;
+
+/**
+ * Consensus ADMM over worker processes has to find the same optimum of the
+ * toy graph as Gauss-Newton with the Cholesky solver on the whole graph.
+ * The poses are split into consecutive ranges, each edge belongs to the
+ * partition of its first pose. The workers send their own poses back
+ * through a pipe, as pose index and tangent coordinates.
+ */
+
+static const int NUM_WORKERS = 3;
+
+struct Setup {
+	ToyGraph graph;
+	int resultFd;
+
+	int owner(int pose) const {
+		return pose * NUM_WORKERS / graph.size();
+	}
+};
+
+static int workerMain(int index, int fd, void *arg){
+	const Setup &setup = *static_cast<const Setup*>(arg);
+	const ToyGraph &g = setup.graph;
+
+	std::map<int, std::set<int> > holders;
+	for(int k=0; k<g.size(); k++) holders[k].insert(setup.owner(k));
+	for(size_t k=0; k<g.edges.size(); k++){
+		holders[g.edges[k].to].insert(setup.owner(g.edges[k].from));
+	}
+
+	Estimator e(Estimator::Cholesky, Estimator::GaussNewton);
+	std::map<int, Pose*> poses;
+	std::deque<Pose> storage;
+	std::deque<Odo> odo;
+	for(int k=0; k<g.size(); k++){
+		if(!holders[k].count(index)) continue;
+		storage.push_back(Pose(g.initial[k], k != 0));
+		poses[k] = &storage.back();
+		e.insertRV(poses[k]);
+	}
+	for(size_t k=0; k<g.edges.size(); k++){
+		const ToyGraph::Edge &edge = g.edges[k];
+		if(setup.owner(edge.from) != index) continue;
+		odo.push_back(Odo(*poses[edge.from], *poses[edge.to], edge.delta,
+				CholeskyCovariance<3>(edge.information, CholeskyMode::CHOLESKY_FULL)));
+		e.insertMeasurement(&odo.back());
+	}
+	ConsensusWorker worker(e, fd);
+	for(std::map<int, Pose*>::iterator it = poses.begin(); it != poses.end(); ++it){
+		if(holders[it->first].size() > 1) worker.addBoundary(it->first, *it->second);
+	}
+	if(!worker.run()) return 1;
+
+	for(std::map<int, Pose*>::iterator it = poses.begin(); it != poses.end(); ++it){
+		if(setup.owner(it->first) != index) continue;
+		double message[4] = {double(it->first)};
+		(*it->second)->sub(message+1, Pose_T());
+		if(write(setup.resultFd, message, sizeof(message)) != sizeof(message)) return 1;
+	}
+	return 0;
+}
+
+int main(){
+	Setup setup;
+	int results[2];
+	CHECK(pipe(results) == 0);
+	setup.resultFd = results[1];
+
+	// fork before the reference estimator exists:
+	std::vector<int> fds;
+	std::vector<pid_t> pids;
+	CHECK(ConsensusCoordinator::spawn(NUM_WORKERS, workerMain, &setup, fds, pids));
+	close(results[1]);
+	ConsensusCoordinator coordinator(fds);
+	ConsensusCoordinator::Stats stats;
+	CHECK(coordinator.run(5000, 1e-6, stats));
+	for(size_t k=0; k<fds.size(); k++) close(fds[k]);
+	CHECK(ConsensusCoordinator::join(pids));
+	CHECK(stats.converged);
+
+	std::vector<Pose_T> consensus(setup.graph.size());
+	std::vector<char> received(setup.graph.size(), false);
+	double message[4];
+	while(read(results[0], message, sizeof(message)) == sizeof(message)){
+		int k = int(message[0]);
+		consensus[k] = Pose_T();
+		consensus[k].add(message+1);
+		received[k] = true;
+	}
+	close(results[0]);
+	CHECK(std::count(received.begin(), received.end(), true) == setup.graph.size());
+
+	std::vector<Pose_T> reference;
+	solveReference(setup.graph, reference);
+	CHECK(maxDifference(consensus, reference) < 1e-4);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
@@ -0,0 +1,54 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <Multilevel.h>
+
+#include <map>
+#include <iostream>
+
+using namespace SLOM;
+
+/**
+ * Solving coarse-to-fine has to reach the same optimum as Gauss-Newton
+ * with the Cholesky solver on the whole graph.
+ */
+
+static const double TOLERANCE = 1e-6;
+
+static void testMultilevel(const ToyGraph &g, const std::vector<Pose_T> &reference,
+		Estimator::Algorithm algorithm){
+	Multilevel<Pose_T> multilevel(Estimator::Cholesky, algorithm);
+	for(int k=0; k<g.size(); k++) multilevel.addPose(k, g.initial[k], k == 0);
+	for(size_t k=0; k<g.edges.size(); k++){
+		const ToyGraph::Edge &e = g.edges[k];
+		multilevel.addEdge(e.from, e.to, e.delta, e.information);
+	}
+	CHECK(multilevel.buildLevels() > 2);
+	multilevel.optimize(50, 50, Estimator::Tolerances(1e-12));
+
+	const std::map<int, Pose_T> &poses = multilevel.getPoses();
+	CHECK((int)poses.size() == g.size());
+	std::vector<Pose_T> result;
+	for(std::map<int, Pose_T>::const_iterator it = poses.begin(); it != poses.end(); ++it){
+		result.push_back(it->second);
+	}
+	CHECK(maxDifference(result, reference) < TOLERANCE);
+}
+
+int main(){
+	// long odometry chains, loops closed only at the corners of the square:
+	ToyGraph full(8, 3), g;
+	g.initial = full.initial;
+	g.edges.clear();
+	for(size_t k=0; k<full.edges.size(); k++){
+		const ToyGraph::Edge &e = full.edges[k];
+		if(e.to == e.from + 1 || e.to % 8 == 0) g.edges.push_back(e);
+	}
+	std::vector<Pose_T> reference;
+	solveReference(g, reference);
+	testMultilevel(g, reference, Estimator::GaussNewton);
+	testMultilevel(g, reference, Estimator::LevenbergMarquardt);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
@@ -0,0 +1,97 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace SLOM;
+
+/**
+ * The ordering cache writes one file per shape of the problem, estimators
+ * initialized from the cached ordering find the same optimum, and unusable
+ * files are ignored and replaced.
+ */
+
+static const double TOLERANCE = 1e-6;
+
+static std::vector<std::string> listFiles(const std::string &directory){
+	std::vector<std::string> result;
+	DIR *dir = opendir(directory.c_str());
+	if(!dir) return result;
+	while(dirent *entry = readdir(dir)){
+		std::string name = entry->d_name;
+		if(name != "." && name != "..") result.push_back(directory + "/" + name);
+	}
+	closedir(dir);
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+static std::string readFile(const std::string &file){
+	std::ifstream in(file.c_str(), std::ios::binary);
+	std::ostringstream content;
+	content << in.rdbuf();
+	return content.str();
+}
+
+/**
+ * Optimizes g with the cache in directory, returns the largest difference
+ * to reference.
+ */
+static double solveCached(const ToyGraph &g, const std::string &directory,
+		const std::vector<Pose_T> &reference){
+	Estimator e(Estimator::Cholesky, Estimator::GaussNewton);
+	e.setOrderingCache(directory);
+	ToyProblem problem(e, g);
+	e.initialize();
+	e.optimize(50, Estimator::Tolerances(1e-12));
+	return problem.maxDifference(reference);
+}
+
+int main(){
+	char directory[] = "/tmp/slom-orderingcache-XXXXXX";
+	CHECK(mkdtemp(directory) != 0);
+
+	ToyGraph g;
+	std::vector<Pose_T> reference;
+	solveReference(g, reference);
+
+	// the first run writes the cache:
+	CHECK(solveCached(g, directory, reference) < TOLERANCE);
+	std::vector<std::string> files = listFiles(directory);
+	CHECK(files.size() == 1);
+	std::string cached = files.empty() ? "" : readFile(files[0]);
+	CHECK(!cached.empty());
+
+	// the second run reads it and leaves it as it is:
+	CHECK(solveCached(g, directory, reference) < TOLERANCE);
+	CHECK(listFiles(directory) == files);
+	CHECK(!files.empty() && readFile(files[0]) == cached);
+
+	// a truncated file is ignored and written again:
+	if(!files.empty()){
+		std::ofstream(files[0].c_str(), std::ios::binary) << cached.substr(0, cached.size()/2);
+	}
+	CHECK(solveCached(g, directory, reference) < TOLERANCE);
+	CHECK(!files.empty() && readFile(files[0]) == cached);
+
+	// another shape gets its own file:
+	ToyGraph other(3, 2);
+	std::vector<Pose_T> otherReference;
+	solveReference(other, otherReference);
+	CHECK(solveCached(other, directory, otherReference) < TOLERANCE);
+	CHECK(listFiles(directory).size() == 2);
+
+	files = listFiles(directory);
+	for(size_t k=0; k<files.size(); k++) std::remove(files[k].c_str());
+	rmdir(directory);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
@@ -0,0 +1,102 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <OutOfCoreCholesky.h>
+
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace SLOM;
+
+/**
+ * The factor out of core has to solve the toy graph like the one in memory,
+ * and a larger factor has to be computed in a window of the file. Without
+ * a scratch file the factor is kept in memory.
+ */
+
+static const double TOLERANCE = 1e-6;
+
+static void testEstimator(const ToyGraph &g, const std::vector<Pose_T> &reference, const char *directory){
+	Estimator e(Estimator::Cholesky, Estimator::GaussNewton);
+	e.setOutOfCore(directory, 0);
+	ToyProblem problem(e, g);
+	e.initialize();
+	e.optimize(50, Estimator::Tolerances(1e-12));
+	CHECK(problem.maxDifference(reference) < TOLERANCE);
+}
+
+/**
+ * Upper triangle of the Laplacian of a side x side grid plus the identity.
+ */
+static cs* gridMatrix(int side){
+	int n = side*side;
+	cs *T = cs_spalloc(n, n, 3*n, 1, 1);
+	for(int r=0; r<side; r++){
+		for(int c=0; c<side; c++){
+			int k = r*side + c;
+			int degree = (r>0) + (r+1<side) + (c>0) + (c+1<side);
+			cs_entry(T, k, k, degree + 1);
+			if(c>0) cs_entry(T, k-1, k, -1);
+			if(r>0) cs_entry(T, k-side, k, -1);
+		}
+	}
+	cs *A = cs_compress(T);
+	cs_spfree(T);
+	return A;
+}
+
+static void testWindow(const char *directory){
+	cs *A = gridMatrix(80);
+	int n = A->n;
+	css *S = cs_schol(0, A);
+	OutOfCoreCholesky::postorder(S, n);
+	OutOfCoreCholesky factorization(directory);
+	const long budget = OutOfCoreCholesky::MIN_WINDOW;
+	csn *N = factorization.factorize(A, S, budget);
+	CHECK(N != 0);
+	CHECK(factorization.getFileBytes() > 4*budget);
+	CHECK(factorization.getPeakBytes() > 0);
+	CHECK(factorization.getPeakBytes() <= budget);
+
+	if(N){
+		// solve A x = b and check the residual:
+		std::vector<double> b(n), x(n), y(n, 0);
+		for(int k=0; k<n; k++) b[k] = std::sin(0.1*k);
+		cs_ipvec(S->pinv, &b[0], &y[0], n);
+		cs_lsolve(N->L, &y[0]);
+		cs_ltsolve(N->L, &y[0]);
+		cs_pvec(S->pinv, &y[0], &x[0], n);
+		std::fill(y.begin(), y.end(), 0);
+		for(int j=0; j<n; j++){
+			for(int p=A->p[j]; p<A->p[j+1]; p++){
+				int i = A->i[p];
+				y[i] += A->x[p] * x[j];
+				if(i != j) y[j] += A->x[p] * x[i];
+			}
+		}
+		double residual = 0;
+		for(int k=0; k<n; k++) residual = std::max(residual, std::abs(y[k] - b[k]));
+		CHECK(residual < 1e-10);
+	}
+	cs_sfree(S);
+	cs_spfree(A);
+}
+
+int main(){
+	char directory[] = "/tmp/slom-outofcore-XXXXXX";
+	CHECK(mkdtemp(directory) != 0);
+
+	ToyGraph g;
+	std::vector<Pose_T> reference;
+	solveReference(g, reference);
+
+	testEstimator(g, reference, directory);
+	testWindow(directory);
+
+	rmdir(directory); // the scratch files are already unlinked
+	testEstimator(g, reference, directory);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
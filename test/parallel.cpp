@@ -0,0 +1,88 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <vector>
+#include <iostream>
+
+using namespace SLOM;
+
+/**
+ * Parallel steps have to give the same results as serial ones: the sums
+ * of evaluate() are bit-identical for any number of threads, and J^T J
+ * assembled by colors of measurements equals the product of the Jacobian.
+ */
+
+static const int THREADS[] = {2, 3, 8};
+static const int NUM_THREADS = sizeof(THREADS)/sizeof(THREADS[0]);
+
+static void testEvaluate(const ToyGraph &g){
+	Estimator e(Estimator::Cholesky, Estimator::GaussNewton);
+	ToyProblem problem(e, g);
+	e.initialize();
+	std::vector<double> serial(3*g.edges.size()), parallel(serial.size());
+	double rss = e.evaluate(&serial[0]);
+	double sum = 0;
+	for(size_t k=0; k<serial.size(); k++) sum += serial[k]*serial[k];
+	CHECK_CLOSE(rss, sum, 1e-12*sum);
+	for(int t=0; t<NUM_THREADS; t++){
+		e.setNumThreads(THREADS[t]);
+		CHECK(e.evaluate(&parallel[0]) == rss);
+		CHECK(parallel == serial);
+	}
+}
+
+/**
+ * The upper triangle of J^T J of one Gauss-Newton step with the given 
+ * number of threads, dense and column major.
+ */
+static void assemble(const ToyGraph &g, int threads, std::vector<double> &JtJ, std::vector<double> &reference){
+	Estimator e(Estimator::Cholesky, Estimator::GaussNewton);
+	e.setNumThreads(threads);
+	ToyProblem problem(e, g);
+	e.initialize();
+	e.optimize(1);
+	const cs *A = e.getNormalEquations(), *J = e.getJacobian();
+	int n = A->n;
+	JtJ.assign(n*n, 0);
+	for(int c=0; c<n; c++){
+		for(int p=A->p[c]; p<A->p[c+1]; p++){
+			CHECK(A->i[p] <= c);
+			JtJ[c*n + A->i[p]] += A->x[p];
+		}
+	}
+	// serially from the columns of J:
+	std::vector<double> a(J->m), b(J->m);
+	reference.assign(n*n, 0);
+	for(int c=0; c<n; c++){
+		std::fill(b.begin(), b.end(), 0);
+		for(int p=J->p[c]; p<J->p[c+1]; p++) b[J->i[p]] = J->x[p];
+		for(int r=0; r<=c; r++){
+			std::fill(a.begin(), a.end(), 0);
+			for(int p=J->p[r]; p<J->p[r+1]; p++) a[J->i[p]] = J->x[p];
+			for(int k=0; k<J->m; k++) reference[c*n + r] += a[k]*b[k];
+		}
+	}
+}
+
+static void testAssembly(const ToyGraph &g){
+	std::vector<double> serial, reference, parallel, unused;
+	assemble(g, 1, serial, reference);
+	double scale = *std::max_element(reference.begin(), reference.end());
+	for(size_t k=0; k<serial.size(); k++){
+		CHECK_CLOSE(serial[k], reference[k], 1e-12*scale);
+	}
+	for(int t=0; t<NUM_THREADS; t++){
+		assemble(g, THREADS[t], parallel, unused);
+		CHECK(parallel == serial);
+	}
+}
+
+int main(){
+	// several chunks of measurements:
+	ToyGraph g(10, 20);
+	testEvaluate(g);
+	testAssembly(ToyGraph());
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
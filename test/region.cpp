@@ -0,0 +1,58 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <set>
+#include <vector>
+#include <iostream>
+
+using namespace SLOM;
+
+/**
+ * optimizeRegion() may only move the variables of the region, and the
+ * whole problem has to be solvable again after initialize().
+ */
+
+static const double TOLERANCE = 1e-6;
+
+static void testRegion(const ToyGraph &g, const std::vector<Pose_T> &reference,
+		Estimator::Algorithm algorithm){
+	Estimator e(Estimator::Cholesky, algorithm);
+	ToyProblem problem(e, g);
+	e.initialize();
+	// a loop closure in the middle of the graph:
+	std::vector<Estimator::RVId> seeds(1, &problem.poses[g.size()/2]), region;
+	e.selectRegion(seeds, 2, region);
+	CHECK(region.size() > 1 && (int)region.size() < g.size() - 1);
+	std::set<Estimator::RVId> inside(region.begin(), region.end());
+
+	std::vector<Pose_T> before, after;
+	problem.getPoses(before);
+	e.optimizeRegion(region, 50, Estimator::Tolerances(1e-12));
+	problem.getPoses(after);
+	int moved = 0;
+	for(int k=0; k<g.size(); k++){
+		std::vector<Pose_T> a(1, before[k]), b(1, after[k]);
+		double d = maxDifference(a, b);
+		if(inside.count(&problem.poses[k])){
+			moved += d > 0;
+		} else {
+			CHECK(d == 0);
+		}
+	}
+	CHECK(moved > 0);
+
+	e.initialize();
+	e.optimize(50, Estimator::Tolerances(1e-12));
+	CHECK(problem.maxDifference(reference) < TOLERANCE);
+}
+
+int main(){
+	ToyGraph g;
+	std::vector<Pose_T> reference;
+	solveReference(g, reference);
+	testRegion(g, reference, Estimator::GaussNewton);
+	testRegion(g, reference, Estimator::LevenbergMarquardt);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
@@ -0,0 +1,114 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <iostream>
+
+using namespace SLOM;
+
+/**
+ * Each solver has to find the same optimum of the toy graph as
+ * Gauss-Newton with the Cholesky solver.
+ */
+
+static const double TOLERANCE = 1e-6;
+
+static void testSubmaps(const ToyGraph &g, const std::vector<Pose_T> &reference){
+	Estimator e(Estimator::Submaps, Estimator::GaussNewton);
+	e.setMaxSubmapSize(6);
+	ToyProblem problem(e, g);
+	e.initialize();
+	CHECK(e.getSubmapSolver()->getNumSubmaps() > 2);
+	CHECK(e.getSubmapSolver()->getSeparatorDim() > 0);
+	e.optimize(50, Estimator::Tolerances(1e-12));
+	CHECK(problem.maxDifference(reference) < TOLERANCE);
+}
+
+/**
+ * With PCG and one CG iteration every candidate falls back to the direct
+ * solver.
+ */
+static void testSpeculativeDamping(const ToyGraph &g, const std::vector<Pose_T> &reference,
+		Estimator::Solver solver){
+	Estimator e(solver, Estimator::LevenbergMarquardt);
+	e.setSpeculativeDamping(3);
+	e.setPCGOptions(1e-12, 1);
+	e.setNumThreads(2);
+	ToyProblem problem(e, g);
+	e.initialize();
+	e.optimize(100, Estimator::Tolerances(1e-12));
+	CHECK(problem.maxDifference(reference) < TOLERANCE);
+}
+
+/**
+ * With one CG iteration PCG can not converge and has to fall back to the
+ * direct solver.
+ */
+static void testPcg(const ToyGraph &g, const std::vector<Pose_T> &reference, int maxIterations){
+	Estimator e(Estimator::PCG, Estimator::GaussNewton);
+	e.setPCGOptions(1e-12, maxIterations);
+	ToyProblem problem(e, g);
+	e.initialize();
+	e.optimize(50, Estimator::Tolerances(1e-12));
+	CHECK(problem.maxDifference(reference) < TOLERANCE);
+	const SubgraphSolver *solver = e.getSubgraphSolver();
+	CHECK(solver->getIterations() <= maxIterations);
+	if(maxIterations == 1) CHECK(solver->getResidual() > 1e-12);
+}
+
+/**
+ * A pose without measurements stops Gauss-Newton before the first step,
+ * the damping of Levenberg keeps the pose in place.
+ */
+static void testUnconstrained(const ToyGraph &g, const std::vector<Pose_T> &reference,
+		Estimator::Algorithm algorithm){
+	Estimator e(Estimator::Cholesky, algorithm);
+	ToyProblem problem(e, g);
+	Pose lonely(Pose_T(), true);
+	e.insertRV(&lonely);
+	e.initialize();
+	CHECK(e.getUnconstrained() == 1);
+	Estimator::StopReason reason = e.optimize(100, Estimator::Tolerances(1e-12));
+	if(algorithm == Estimator::GaussNewton){
+		CHECK(reason == Estimator::Unconstrained);
+		CHECK(e.getIterations() == 0);
+	} else {
+		CHECK(problem.maxDifference(reference) < TOLERANCE);
+		std::vector<Pose_T> moved(1, *lonely);
+		CHECK(maxDifference(moved, std::vector<Pose_T>(1, Pose_T())) == 0);
+	}
+}
+
+/**
+ * LBFGS only converges linearly, the threads are changed after
+ * initialize() to cover reallocating the per-thread buffers. The pool
+ * is resized, not replaced.
+ */
+static void testLbfgs(const ToyGraph &g, const std::vector<Pose_T> &reference){
+	Estimator e(Estimator::Cholesky, Estimator::LBFGS);
+	ToyProblem problem(e, g);
+	e.initialize();
+	ThreadPool &pool = e.getThreadPool();
+	e.setNumThreads(3);
+	CHECK(&pool == &e.getThreadPool() && pool.getNumThreads() == 3);
+	e.optimize(2000, Estimator::Tolerances(1e-14));
+	CHECK(problem.maxDifference(reference) < 1e-4);
+}
+
+int main(){
+	ToyGraph g;
+	std::vector<Pose_T> reference;
+	solveReference(g, reference);
+	CHECK(maxDifference(g.initial, reference) > 0.1); // the initial poses are not optimal
+
+	testSubmaps(g, reference);
+	testSpeculativeDamping(g, reference, Estimator::Cholesky);
+	testSpeculativeDamping(g, reference, Estimator::PCG);
+	testPcg(g, reference, 1000);
+	testPcg(g, reference, 1);
+	testLbfgs(g, reference);
+	testUnconstrained(g, reference, Estimator::GaussNewton);
+	testUnconstrained(g, reference, Estimator::Levenberg);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
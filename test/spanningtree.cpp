@@ -0,0 +1,77 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <tools/SpanningTree.h>
+
+#include <map>
+#include <iostream>
+
+using namespace SLOM;
+
+/**
+ * The initial poses of a SpanningTree have to satisfy the edges of the
+ * tree exactly, up to rounding, in either direction of the edges. With
+ * uncertain loop closures the tree is the odometry, i.e. dead reckoning.
+ */
+
+static const double TOLERANCE = 1e-9;
+
+/**
+ * Number of edges of g which the poses satisfy.
+ */
+static int satisfied(const ToyGraph &g, const std::map<int, Pose_T> &poses){
+	int count = 0;
+	for(size_t k=0; k<g.edges.size(); k++){
+		const ToyGraph::Edge &e = g.edges[k];
+		std::vector<Pose_T> a(1, poses.find(e.from)->second.world2Local(poses.find(e.to)->second));
+		std::vector<Pose_T> b(1, e.delta);
+		count += maxDifference(a, b) < TOLERANCE;
+	}
+	return count;
+}
+
+/**
+ * Every second odometry edge is added reversed, loop closures get the
+ * given uncertainty.
+ */
+static void testTree(const ToyGraph &g, double loopUncertainty){
+	SpanningTree<Pose_T> tree;
+	const double origin[3] = {1, 2, 0.5};
+	Pose_T root(origin, origin[2]);
+	tree.addRoot(0, root);
+	for(size_t k=0; k<g.edges.size(); k++){
+		const ToyGraph::Edge &e = g.edges[k];
+		bool odometry = e.to == e.from + 1;
+		double uncertainty = odometry ? 1 : loopUncertainty;
+		if(odometry && e.from % 2){
+			tree.addEdge(e.to, e.from, PoseGraph::Inverse<Pose_T>()(e.delta), uncertainty);
+		} else {
+			tree.addEdge(e.from, e.to, e.delta, uncertainty);
+		}
+	}
+	std::map<int, Pose_T> poses;
+	CHECK(tree.compose(poses) == 1);
+	CHECK((int)poses.size() == g.size());
+	if((int)poses.size() != g.size()) return;
+	std::vector<Pose_T> a(1, poses[0]), b(1, root);
+	CHECK(maxDifference(a, b) == 0);
+	// the tree has one edge less than poses, the other edges are noisy:
+	CHECK(satisfied(g, poses) == g.size() - 1);
+
+	if(loopUncertainty > g.size()){
+		// dead reckoning from the root:
+		for(int k=0; k<g.size(); k++){
+			std::vector<Pose_T> p(1, poses[k]), q(1, root.local2World(g.initial[k]));
+			CHECK(maxDifference(p, q) < TOLERANCE);
+		}
+	}
+}
+
+int main(){
+	ToyGraph g;
+	testTree(g, 1000);
+	testTree(g, 0.5);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}
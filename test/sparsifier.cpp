@@ -0,0 +1,95 @@
+#include "Check.h"
+#include "ToyGraph.h"
+
+#include <Sparsifier.h>
+
+#include <map>
+#include <iostream>
+
+using namespace SLOM;
+
+/**
+ * The sparsified graph has to keep the objective of the Estimator, also for
+ * information matrices which are not diagonal: a pose with two neighbors
+ * becomes the composition of its edges, and the remaining poses of a
+ * sparsified graph stay close to the optimum of the whole graph.
+ */
+
+static const double INFORMATION[9] = {400, 150, 100,  150, 300, 80,  100, 80, 2500};
+
+static void correlate(ToyGraph &g){
+	for(size_t k=0; k<g.edges.size(); k++){
+		std::copy(INFORMATION, INFORMATION+9, g.edges[k].information);
+	}
+}
+
+static void testChain(){
+	const double d1[3] = {1, 0.2, 0.3}, d2[3] = {0.8, -0.1, -0.5};
+	PoseGraphEdge<Pose_T> first(0, 1, Pose_T(d1, d1[2]), INFORMATION), second(1, 2, Pose_T(d2, d2[2]), INFORMATION);
+	PoseGraphEdge<Pose_T> composed;
+	PoseGraphEdge<Pose_T>::compose(first, second, composed);
+
+	Sparsifier<Pose_T> sparsifier;
+	const double offset[3] = {0.1, -0.05, 0.02};
+	Pose_T v = first.delta, b = composed.delta;
+	v.add(offset);
+	b.add(offset, -1);
+	sparsifier.addPose(0, Pose_T(), true);
+	sparsifier.addPose(1, v);
+	sparsifier.addPose(2, b, true);
+	sparsifier.addEdge(first.from, first.to, first.delta, first.information);
+	sparsifier.addEdge(second.from, second.to, second.delta, second.information);
+	CHECK(sparsifier.sparsify(10) == 1);
+	CHECK(sparsifier.getEdges().size() == 1);
+	if(sparsifier.getEdges().size() != 1) return;
+
+	const PoseGraphEdge<Pose_T> &e = sparsifier.getEdges()[0];
+	CHECK(e.from == 0 && e.to == 2);
+	double d[3];
+	e.delta.sub(d, composed.delta);
+	for(int i=0; i<3; i++) CHECK_CLOSE(d[i], 0, 1e-9);
+	for(int k=0; k<9; k++) CHECK_CLOSE(e.information[k], composed.information[k], 1e-6*composed.information[8]);
+}
+
+/**
+ * Removes poses with at most maxNeighbors neighbors from the optimum of g
+ * and solves the remaining graph from dead reckoning.
+ */
+static void testGraph(const ToyGraph &g, const std::vector<Pose_T> &reference,
+		int maxNeighbors, double tolerance){
+	Sparsifier<Pose_T> sparsifier;
+	for(int k=0; k<g.size(); k++) sparsifier.addPose(k, reference[k], k == 0);
+	for(size_t k=0; k<g.edges.size(); k++){
+		const ToyGraph::Edge &e = g.edges[k];
+		sparsifier.addEdge(e.from, e.to, e.delta, e.information);
+	}
+	int removed = sparsifier.sparsify(1.5, maxNeighbors);
+	CHECK(removed > 0);
+
+	// start from dead reckoning, not from the optimum:
+	const std::map<int, Pose_T> &poses = sparsifier.getPoses();
+	ToyGraph sparse(g.initial, poses, sparsifier.getEdges());
+	CHECK(sparse.size() + removed == g.size());
+	std::vector<Pose_T> remainingReference;
+	for(std::map<int, Pose_T>::const_iterator it = poses.begin(); it != poses.end(); ++it){
+		remainingReference.push_back(reference[it->first]);
+	}
+	std::vector<Pose_T> result;
+	solveReference(sparse, result);
+	CHECK(maxDifference(result, remainingReference) < tolerance);
+}
+
+int main(){
+	testChain();
+
+	ToyGraph g;
+	correlate(g);
+	std::vector<Pose_T> reference;
+	solveReference(g, reference);
+	// two neighbors are exact up to linearization, more are approximated by a tree:
+	testGraph(g, reference, 2, 5e-4);
+	testGraph(g, reference, 4, 0.03);
+
+	std::cout << (checkFailures ? "FAILED" : "passed") << std::endl;
+	return checkFailures;
+}